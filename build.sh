@@ -6,8 +6,15 @@ mkdir -p ./build/
 mkdir -p ./wasm/
 
 CFLAGS="-O3 -Wall -Wextra -g -pedantic `pkg-config --libs raylib`"
-CLIBS="`pkg-config --libs raylib` -lm"
+CLIBS="`pkg-config --libs raylib` -lm -lpthread -lGL"
 
 clang $CFLAGS -o ./build/balls ./src/balls.c $CLIBS
-clang --target=wasm32 -I./include/ --no-standard-libraries -Wl,--export-table -Wl,--no-entry -Wl,--allow-undefined -Wl,--export=main -Wl,--export=__head_base -Wl,--allow-undefined -o ./wasm/balls.wasm ./src/balls.c -DPLATFORM_WEB
+clang --target=wasm32 -I./include/ --no-standard-libraries -Wl,--export-table -Wl,--no-entry -Wl,--allow-undefined -Wl,--export=main -Wl,--export=__heap_base -o ./wasm/balls.wasm ./src/balls.c -DPLATFORM_WEB
+clang --target=wasm32 -O3 -I./include/ --no-standard-libraries -Wl,--export-table -Wl,--no-entry -Wl,--allow-undefined -Wl,--export=main -Wl,--export=__heap_base -o ./wasm/balls_sw.wasm ./src/balls.c -DPLATFORM_WEB -DSOFTWARE_RENDER
+clang --target=wasm32 -O2 -matomics -mbulk-memory -mmutable-globals -I./include/ --no-standard-libraries -Wl,--export-table -Wl,--no-entry -Wl,--allow-undefined -Wl,--export=main -Wl,--export=__heap_base -Wl,--import-memory -Wl,--shared-memory -Wl,--initial-memory=16777216 -Wl,--max-memory=67108864 -Wl,--export=__stack_pointer -Wl,--export=jobs_worker_main -Wl,--export=jobs_worker_stack -o ./wasm/balls_mt.wasm ./src/balls.c -DPLATFORM_WEB -DJOBS_WASM_THREADS
+clang --target=wasm32 -O3 -msimd128 -mbulk-memory -I./include/ --no-standard-libraries -Wl,--export-table -Wl,--no-entry -Wl,--allow-undefined -Wl,--export=main -Wl,--export=__heap_base -o ./wasm/balls_simd.wasm ./src/balls.c -DPLATFORM_WEB
 
+# Content hashes, raylib.js keys its cache of compiled modules by them
+for wasm in ./wasm/*.wasm; do
+    sha256sum "$wasm" | cut -d' ' -f1 > "$wasm.sha256"
+done
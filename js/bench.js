@@ -0,0 +1,357 @@
+#!/usr/bin/env node
+// Headless benchmark of a web build: runs the module under Node with the real
+// RaylibJs imports drawing into a 2D context that does nothing, so the
+// numbers are the simulation in wasm plus the JS side of every import.
+// Input is scripted and rand() is seeded, every run does the same work.
+// Garbage collections in the measured frames are counted as well, they follow
+// how much raylib.js allocates per frame, and so are the calls into the 2D
+// context per method.
+//
+//   $ node js/bench.js --frames 1000 --size 1920x1080
+//   $ node js/bench.js --wasm wasm/balls_sw.wasm --json
+//
+// --check runs two builds of the same game (e.g. baseline and SIMD) through
+// the same frames and compares what they draw, frame by frame.
+//
+//   $ node js/bench.js --check wasm/balls.wasm wasm/balls_simd.wasm
+"use strict";
+
+const fs = require("fs");
+const path = require("path");
+const vm = require("vm");
+const { PerformanceObserver } = require("perf_hooks");
+
+// raylib.js is a plain browser script, its classes live in the global scope it's run in
+const { RaylibJs, CanvasState, make_environment } = vm.runInThisContext(
+    fs.readFileSync(path.join(__dirname, "raylib.js"), "utf8") + "\n;({RaylibJs, CanvasState, make_environment})",
+    { filename: "raylib.js" });
+
+function usage() {
+    console.log(`Usage: node js/bench.js [OPTIONS]
+  --wasm PATH      Module to run (default: wasm/balls.wasm)
+  --frames N       Frames to run (default: 1000)
+  --warmup N       Frames to run before measuring (default: 60)
+  --size WxH       Canvas size (default: 1920x1080)
+  --seed N         Seed for rand() (default: 1)
+  --json           Print the report as JSON
+  --check A B      Check that modules A and B draw the same frames`);
+}
+
+function parse_args(argv) {
+    const options = {
+        wasm: path.join(__dirname, "..", "wasm", "balls.wasm"),
+        frames: 1000,
+        warmup: 60,
+        width: 1920,
+        height: 1080,
+        seed: 1,
+        json: false,
+        check: undefined,
+    };
+    for (let i = 0; i < argv.length; ++i) {
+        const arg = argv[i];
+        const value = () => {
+            if (i + 1 >= argv.length) throw new Error(`${arg} needs a value`);
+            return argv[++i];
+        };
+        switch (arg) {
+        case "--wasm": options.wasm = value(); break;
+        case "--frames": options.frames = parseInt(value(), 10); break;
+        case "--warmup": options.warmup = parseInt(value(), 10); break;
+        case "--size": {
+            const match = /^(\d+)x(\d+)$/.exec(value());
+            if (match === null) throw new Error("--size expects WIDTHxHEIGHT");
+            options.width = parseInt(match[1], 10);
+            options.height = parseInt(match[2], 10);
+        } break;
+        case "--seed": options.seed = parseInt(value(), 10); break;
+        case "--json": options.json = true; break;
+        case "--check": options.check = [value(), value()]; break;
+        case "--help": usage(); process.exit(0);
+        default: throw new Error(`unknown option ${arg}`);
+        }
+    }
+    if (!(options.frames > 0) || !(options.warmup >= 0)) throw new Error("--frames and --warmup must be numbers");
+    return options;
+}
+
+// Accepts any property and turns any method call into a no-op that returns
+// another null object, which covers gradients, measureText and the like. The
+// result of a method is made once and reused, so drawing doesn't allocate.
+const NULL_RESULT = Symbol("result");
+
+function null_object() {
+    const target = function () {};
+    target.width = 0;
+    return new Proxy(target, {
+        get: (target, key) => key in target ? target[key] : (target[key] = null_object()),
+        apply: (target) => target[NULL_RESULT] !== undefined ? target[NULL_RESULT] : (target[NULL_RESULT] = null_object()),
+    });
+}
+
+// A null 2D context that counts the calls of each of its methods, the
+// number of fill() and drawImage() calls is what batching in raylib.js saves
+function counting_context() {
+    const calls = new Map();
+    const methods = {};
+    const ctx = new Proxy({}, {
+        get: (target, key) => {
+            if (key in target) return target[key];
+            if (methods[key] === undefined) {
+                const record = {calls: 0};
+                const result = null_object();
+                calls.set(key, record);
+                methods[key] = function () {
+                    record.calls += 1;
+                    return result;
+                };
+            }
+            return methods[key];
+        },
+    });
+    return {ctx, calls};
+}
+
+// A null 2D context that folds every call and assignment into a running
+// FNV-1a hash, objects only count by type since sprites differ per run
+function recording_context() {
+    const recorder = {hash: 0x811C9DC5};
+    const mix = (value) => {
+        const text = typeof value === "object" || typeof value === "function" ? typeof value : String(value);
+        let hash = recorder.hash;
+        for (let i = 0; i < text.length; ++i) hash = Math.imul(hash ^ text.charCodeAt(i), 0x01000193);
+        recorder.hash = Math.imul(hash ^ 0xFF, 0x01000193) >>> 0;
+    };
+    const methods = {};
+    const ctx = new Proxy({}, {
+        get: (target, key) => {
+            if (key in target) return target[key];
+            if (methods[key] === undefined) {
+                methods[key] = (...args) => {
+                    mix(key);
+                    for (const arg of args) mix(arg);
+                    return null_object();
+                };
+            }
+            return methods[key];
+        },
+        set: (target, key, value) => {
+            mix(key);
+            mix(value);
+            target[key] = value;
+            return true;
+        },
+    });
+    return {ctx, recorder};
+}
+
+if (typeof ImageData === "undefined") {
+    globalThis.ImageData = class ImageData {
+        constructor(data, width, height) {
+            this.data = data;
+            this.width = width;
+            this.height = height;
+        }
+    };
+}
+
+// Same generator and range as glibc's rand() TYPE_0, good enough and reproducible
+function seeded_rand(seed) {
+    let state = seed >>> 0;
+    return () => {
+        state = (Math.imul(state, 1103515245) + 12345) >>> 0;
+        return state & 0x7FFFFFFF;
+    };
+}
+
+// The mouse sweeps a Lissajous curve over the canvas, and now and then clicks
+// the "Pop on collision" toggle or presses space and T
+function scripted_input(frame, width, height) {
+    const t = frame/60;
+    const messages = [{
+        type: "mousemove",
+        x: width*(0.5 + 0.45*Math.sin(1.3*t)),
+        y: height*(0.5 + 0.45*Math.sin(1.7*t + 0.5)),
+    }];
+    if (frame%240 === 120) {
+        messages.unshift({type: "mousemove", x: 20, y: 20});
+        messages.push({type: "mousedown", button: 0}, {type: "mouseup", button: 0});
+    }
+    if (frame%600 === 300) messages.push({type: "keydown", code: "Space"}, {type: "keyup", code: "Space"});
+    if (frame%900 === 450) messages.push({type: "keydown", code: "KeyT"}, {type: "keyup", code: "KeyT"});
+    return messages;
+}
+
+// Runs the module for the warmup and measured frames. With record the draw
+// calls are hashed and the hashes of the measured frames returned too.
+function run(options, wasmPath, record) {
+    const module = new WebAssembly.Module(fs.readFileSync(wasmPath));
+    if (WebAssembly.Module.imports(module).some(({kind}) => kind === "memory")) {
+        console.error("ERROR: the threads build needs workers and shared memory, bench the single-threaded build instead");
+        process.exit(1);
+    }
+
+    const raylibJs = new RaylibJs();
+    raylibJs.viewport = {width: options.width, height: options.height, pixelRatio: 1};
+    raylibJs.canvas = {width: options.width, height: options.height};
+    const recording = record ? recording_context() : undefined;
+    const counting = record ? undefined : counting_context();
+    raylibJs.ctx = record ? recording.ctx : counting.ctx;
+    raylibJs.state = new CanvasState(raylibJs.ctx);
+
+    // Every import goes through a wrapper that counts and times it
+    const now = () => performance.now();
+    const stats = new Map();
+    const env = {};
+    const overrides = {rand: seeded_rand(options.seed)};
+    for (const {name, kind} of WebAssembly.Module.imports(module)) {
+        if (kind !== "function" || typeof raylibJs[name] !== "function") continue;
+        const fn = overrides[name] !== undefined ? overrides[name] : raylibJs[name];
+        const record = {calls: 0, ms: 0};
+        stats.set(name, record);
+        // arguments rather than a rest parameter, the wrapper shouldn't show up in the GC numbers
+        env[name] = function () {
+            const start = now();
+            try {
+                return fn.apply(raylibJs, arguments);
+            } finally {
+                record.ms += now() - start;
+                record.calls += 1;
+            }
+        };
+    }
+
+    const instance = new WebAssembly.Instance(module, make_environment(module, env));
+    raylibJs.wasm = {module, instance};
+    raylibJs.memory = instance.exports.memory;
+    instance.exports.main();
+    if (raylibJs.entryFunction === undefined) {
+        console.error("ERROR: the module didn't register a frame function with raylib_js_set_entry");
+        process.exit(1);
+    }
+
+    const dt = 1/60;
+    let frame = 0;
+    for (; frame < options.warmup; ++frame) raylibJs.step(dt, scripted_input(frame, options.width, options.height));
+    for (const record of stats.values()) {
+        record.calls = 0;
+        record.ms = 0;
+    }
+    if (counting !== undefined) {
+        for (const record of counting.calls.values()) record.calls = 0;
+    }
+
+    const digests = [];
+    const start = now();
+    for (let i = 0; i < options.frames; ++i, ++frame) {
+        raylibJs.step(dt, scripted_input(frame, options.width, options.height));
+        if (record) {
+            digests.push(recording.recorder.hash);
+            recording.recorder.hash = 0x811C9DC5;
+        }
+    }
+    const end = now();
+    const total = end - start;
+
+    const imports = [...stats.entries()]
+        .filter(([, record]) => record.calls > 0)
+        .sort((a, b) => b[1].ms - a[1].ms)
+        .map(([name, record]) => ({
+            name,
+            calls: record.calls,
+            callsPerFrame: record.calls/options.frames,
+            ms: record.ms,
+            usPerCall: 1000*record.ms/record.calls,
+        }));
+    const importMs = imports.reduce((sum, entry) => sum + entry.ms, 0);
+    const canvas = counting === undefined ? [] : [...counting.calls.entries()]
+        .filter(([, record]) => record.calls > 0)
+        .sort((a, b) => b[1].calls - a[1].calls)
+        .map(([name, record]) => ({name, calls: record.calls, callsPerFrame: record.calls/options.frames}));
+    const report = {
+        wasm: path.relative(process.cwd(), wasmPath),
+        width: options.width,
+        height: options.height,
+        frames: options.frames,
+        totalMs: total,
+        fps: 1000*options.frames/total,
+        msPerFrame: total/options.frames,
+        importMs,
+        // Includes the timing wrappers themselves, so it's an upper bound for the JS side
+        wasmMs: total - importMs,
+        imports,
+        canvas,
+        startMs: start,
+        endMs: end,
+    };
+    return {report, digests};
+}
+
+// Garbage collections while fn() runs. Node delivers the entries
+// asynchronously and not within a single turn of the event loop, so they are
+// collected a little later and filtered by the window the report was measured in.
+async function with_gc(fn) {
+    const entries = [];
+    const observer = new PerformanceObserver((list) => entries.push(...list.getEntries()));
+    observer.observe({entryTypes: ["gc"]});
+    const result = fn();
+    await new Promise((resolve) => setTimeout(resolve, 100));
+    observer.disconnect();
+    const {report} = result;
+    const measured = entries.filter((entry) => entry.startTime >= report.startMs && entry.startTime < report.endMs);
+    report.gc = {
+        count: measured.length,
+        // Scavenges of the young generation, their number follows the allocation rate
+        minor: measured.filter((entry) => entry.detail.kind === 1).length,
+        ms: measured.reduce((sum, entry) => sum + entry.duration, 0),
+    };
+    return result;
+}
+
+function check(options) {
+    const [a, b] = options.check.map((wasmPath) => run(options, wasmPath, true));
+    const frame = a.digests.findIndex((digest, i) => digest !== b.digests[i]);
+    if (frame >= 0) {
+        console.log(`MISMATCH: ${a.report.wasm} and ${b.report.wasm} draw different things from frame ${options.warmup + frame} on`);
+        process.exit(1);
+    }
+    console.log(`OK: ${a.report.wasm} and ${b.report.wasm} drew the same ${options.frames} frames`);
+    console.log(`  ${a.report.wasm}: ${a.report.msPerFrame.toFixed(3)} ms/frame`);
+    console.log(`  ${b.report.wasm}: ${b.report.msPerFrame.toFixed(3)} ms/frame`);
+}
+
+async function main() {
+    let options;
+    try {
+        options = parse_args(process.argv.slice(2));
+    } catch (e) {
+        console.error(`ERROR: ${e.message}`);
+        usage();
+        process.exit(1);
+    }
+    if (options.check !== undefined) {
+        check(options);
+        return;
+    }
+
+    const {report} = await with_gc(() => run(options, options.wasm, false));
+    const imports = report.imports;
+    if (options.json) {
+        console.log(JSON.stringify(report, null, 2));
+        return;
+    }
+    console.log(`${report.wasm} ${report.width}x${report.height}, ${report.frames} frames`);
+    console.log(`  ${report.fps.toFixed(1)} frames/s, ${report.msPerFrame.toFixed(3)} ms/frame`);
+    console.log(`  ${(100*report.importMs/report.totalMs).toFixed(1)}% of the time in imports, ${(100*report.wasmMs/report.totalMs).toFixed(1)}% in wasm`);
+    console.log(`  ${report.gc.count} garbage collections (${report.gc.minor} minor), ${report.gc.ms.toFixed(2)} ms`);
+    const canvasCalls = (name) => (report.canvas.find((entry) => entry.name === name) || {callsPerFrame: 0}).callsPerFrame;
+    console.log(`  ${canvasCalls("fill").toFixed(1)} fill() and ${canvasCalls("drawImage").toFixed(1)} drawImage() calls per frame`);
+    console.log();
+    console.log(`  ${"import".padEnd(32)}${"calls".padStart(10)}${"/frame".padStart(10)}${"ms".padStart(10)}${"us/call".padStart(10)}`);
+    for (const entry of imports) {
+        console.log(`  ${entry.name.padEnd(32)}${String(entry.calls).padStart(10)}${entry.callsPerFrame.toFixed(1).padStart(10)}` +
+            `${entry.ms.toFixed(2).padStart(10)}${entry.usPerCall.toFixed(3).padStart(10)}`);
+    }
+}
+
+main();
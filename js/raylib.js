@@ -1,14 +1,30 @@
-function make_environment(env) {
-    return new Proxy(env, {
-        get(target, prop, receiver) {
-            if (env[prop] !== undefined) {
-                return env[prop].bind(env);
-            }
-            return (...args) => {
-                throw new Error(`NOT IMPLEMENTED: ${prop} ${args}`);
-            }
+// Builds the import object once from the module's own import list, so every
+// call goes straight to a bound method. Imports the environment doesn't
+// implement are reported together at load time and throw if they are called.
+// A memory import (the threads build) is taken from env.memory.
+function make_environment(module, env, report = true) {
+    const imports = {};
+    const missing = [];
+    for (const {module: namespace, name, kind} of WebAssembly.Module.imports(module)) {
+        if (imports[namespace] === undefined) imports[namespace] = {};
+        if (kind === "memory") {
+            imports[namespace][name] = env.memory;
+            continue;
+        }
+        if (kind !== "function") continue;
+        if (typeof env[name] === "function") {
+            imports[namespace][name] = env[name].bind(env);
+        } else {
+            missing.push(`${namespace}.${name}`);
+            imports[namespace][name] = (...args) => {
+                throw new Error(`NOT IMPLEMENTED: ${name} ${args}`);
+            };
         }
-    });
+    }
+    if (report && missing.length > 0) {
+        console.error(`NOT IMPLEMENTED: the module imports ${missing.join(", ")}`);
+    }
+    return imports;
 }
 
 let iota = 0;
@@ -21,6 +37,123 @@ const LOG_ERROR   = iota++; // Error logging, used on unrecoverable failures
 const LOG_FATAL   = iota++; // Fatal logging, used to abort program: exit(EXIT_FAILURE)
 const LOG_NONE    = iota++; // Disable logging
 
+// Where raylib.js itself was loaded from, a worker started by start({worker: true}) and the job workers of
+// the threads build run this same script
+const RAYLIB_JS_URL = typeof document !== "undefined"
+    ? (document.currentScript ? document.currentScript.src : undefined)
+    : (typeof WorkerGlobalScope !== "undefined" ? self.location.href : undefined);
+
+// Shared memory of the threads build in 64KiB pages, has to match --initial-memory and --max-memory in build.sh
+const THREADS_MEMORY_INITIAL = 256;
+const THREADS_MEMORY_MAXIMUM = 1024;
+
+// A function returning i8x16.popcnt(i8x16.splat(0)), only valid where fixed-width SIMD is supported.
+// Validating it is synchronous and compiles nothing, so the check costs next to nothing at startup.
+const WASM_SIMD_PROBE = new Uint8Array([
+    0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00,     // magic, version
+    0x01, 0x05, 0x01, 0x60, 0x00, 0x01, 0x7b,           // type: () -> v128
+    0x03, 0x02, 0x01, 0x00,                             // function 0 has type 0
+    0x0a, 0x0a, 0x01, 0x08, 0x00,                       // code: one body, no locals
+    0x41, 0x00, 0xfd, 0x0f, 0xfd, 0x62, 0x0b,           // i32.const 0, i8x16.splat, i8x16.popcnt, end
+]);
+
+function wasm_simd_supported() {
+    try {
+        return WebAssembly.validate(WASM_SIMD_PROBE);
+    } catch (e) {
+        return false;
+    }
+}
+
+// TODO: since the default font is part of Raylib the css that defines it should be located in raylib.js and not in index.html.
+// Workers don't see the page's @font-face rules, so there it is loaded from here.
+const GRIXEL_FONT_PATH = "./assets/fonts/acme_7_wide_xtnd.woff";
+
+// Compiled modules are kept in the Cache API under the content hash that
+// build.sh writes next to each module (balls.wasm.sha256). Browsers can't
+// store a WebAssembly.Module in IndexedDB anymore, but they do keep the
+// machine code of modules compiled from a cached Response, so a cache hit
+// skips both the download and the compilation. Without a hash file or the
+// Cache API (e.g. file:// or insecure origins) it's a plain streaming compile.
+// A download is only stored when its bytes match the hash, so a hash file left
+// over from another build can't pin a module that doesn't belong to it.
+const WASM_CACHE_NAME = "raylib-js-wasm";
+
+async function compile_module(wasmPath) {
+    const url = new URL(wasmPath, globalThis.location.href);
+    let hash = undefined;
+    if (typeof caches !== "undefined") {
+        try {
+            const response = await fetch(`${url.href}.sha256`, {cache: "no-cache"});
+            if (response.ok) hash = (await response.text()).trim();
+        } catch (e) {
+            // No hash, no cache
+        }
+    }
+    if (!hash) {
+        return {module: await WebAssembly.compileStreaming(fetch(url)), source: "network"};
+    }
+
+    const cache = await caches.open(WASM_CACHE_NAME);
+    const key = `${url.origin}${url.pathname}?sha256=${hash}`;
+    const cached = await cache.match(key);
+    if (cached !== undefined) {
+        try {
+            return {module: await WebAssembly.compileStreaming(cached), source: "cache"};
+        } catch (e) {
+            console.warn(`Cached ${url.pathname} could not be compiled, fetching it again`, e);
+            await cache.delete(key);
+        }
+    }
+
+    const response = await fetch(url);
+    const module = await WebAssembly.compileStreaming(response.clone());
+    // Not awaited, the game can start while the module is stored
+    (async () => {
+        const digest = new Uint8Array(await crypto.subtle.digest("SHA-256", await response.clone().arrayBuffer()));
+        const actual = Array.from(digest, (byte) => byte.toString(16).padStart(2, "0")).join("");
+        if (actual !== hash) {
+            console.warn(`${url.pathname} doesn't match ${url.pathname}.sha256, not caching it. Run build.sh again?`);
+            return;
+        }
+        // Older builds of the same module are of no use anymore
+        for (const request of await cache.keys()) {
+            if (new URL(request.url).pathname === url.pathname && request.url !== key) await cache.delete(request);
+        }
+        await cache.put(key, response);
+    })().catch((e) => console.warn(`Could not cache ${url.pathname}`, e));
+    return {module, source: "network"};
+}
+
+// Dedicated workers have requestAnimationFrame in most browsers, the rest get a timer
+const requestFrame = typeof requestAnimationFrame === "function"
+    ? (callback) => requestAnimationFrame(callback)
+    : (callback) => setTimeout(() => callback(performance.now()), 1000/60);
+
+// Key and button state is kept as bitsets, see InputSnapshot in src/balls.c
+const INPUT_KEY_WORDS = 16;
+
+function test_bit(bits, index) {
+    if (index < 0 || index >= bits.length*32) return false;
+    return (bits[index >>> 5] & (1 << (index & 31))) !== 0;
+}
+
+function set_bit(bits, index) {
+    if (index >= 0 && index < bits.length*32) bits[index >>> 5] |= 1 << (index & 31);
+}
+
+function clear_bit(bits, index) {
+    if (index >= 0 && index < bits.length*32) bits[index >>> 5] &= ~(1 << (index & 31));
+}
+
+// Draw command ops, must match CommandOp in src/balls.c
+iota = 1;
+const COMMAND_CLEAR           = iota++;
+const COMMAND_RECTANGLE       = iota++;
+const COMMAND_CIRCLE          = iota++;
+const COMMAND_CIRCLE_GRADIENT = iota++;
+const COMMAND_TEXT            = iota++;
+
 class RaylibJs {
     // TODO: We stole the font from the website
     // (https://raylib.com/) and it's slightly different than
@@ -32,20 +165,60 @@ class RaylibJs {
     #FONT_SCALE_MAGIC = 0.65;
 
     #reset() {
-        this.previous = undefined;
         this.wasm = undefined;
+        this.canvas = undefined;
         this.ctx = undefined;
-        this.dt = undefined;
-        this.targetFPS = 60;
+        this.state = undefined;
+        this.gradientSprites = new GradientSprites();
+        this.textLabels = new TextLabels((image) => {
+            if (this.gl !== undefined) this.gl.releaseImage(image);
+        });
+        this.circles = new CircleBatch();
+        this.gl = undefined;
+        this.dt = 0;
+        this.pacer = new FramePacer();
+        this.stats = undefined;     // Last stats posted by the worker
+        this.startup = undefined;   // How the module was loaded and how long the first frame took
+        this.hud = undefined;       // PerfHud, with start({hud: true})
+        this.wasmPath = undefined;
         this.entryFunction = undefined;
-        this.prevPressedKeyState = new Set();
-        this.currentPressedKeyState = new Set();
-        this.prevMouseButtonState = new Set();
-        this.currentMouseButtonState = new Set();
-        this.currentMouseWheelMoveState = 0;
-        this.prevMousePosition = {x: 0, y: 0};
-        this.currentMousePosition = {x: 0, y: 0};
+        // Live input state, updated by #input() as events arrive
+        this.mouseX = 0;
+        this.mouseY = 0;
+        this.wheel = 0;
+        this.buttonsDown = 0;
+        this.buttonsPressed = 0;    // Went down since the last snapshot
+        this.keysDown = new Uint32Array(INPUT_KEY_WORDS);
+        this.keysPressed = new Uint32Array(INPUT_KEY_WORDS);
+        // What the current frame sees, taken by #snapshotInput() before each frame
+        this.frame = {
+            mouseX: 0, mouseY: 0,
+            deltaX: 0, deltaY: 0,
+            wheel: 0,
+            buttonsDown: 0,
+            buttonsPressed: 0,
+            keysDown: new Uint32Array(INPUT_KEY_WORDS),
+            keysPressed: new Uint32Array(INPUT_KEY_WORDS),
+        };
+        this.inputPtr = undefined;
         this.images = [];
+        this.blitImage = undefined;
+        this.commandBuffer = undefined;
+        this.HEAPU8 = undefined;
+        this.HEAPU32 = undefined;
+        this.HEAPF32 = undefined;
+        this.HEAPVIEW = undefined;
+        this.worker = undefined;
+        this.memory = undefined;
+        this.jobWorkers = [];
+        this.removeListeners = undefined;
+        this.element = undefined;   // The DOM canvas, on the main thread
+        this.viewport = {width: 0, height: 0, pixelRatio: 1};
+        this.renderScale = 1;
+        this.screenWidth = 0;       // Logical size the game sees, CSS pixels
+        this.screenHeight = 0;
+        this.pixelRatio = 1;        // Canvas pixels per logical pixel
+        this.blits = false;         // The module renders its own frames at the logical size
         this.quit = false;
     }
 
@@ -54,95 +227,461 @@ class RaylibJs {
     }
 
     stop() {
+        if (this.worker !== undefined) {
+            this.worker.terminate();
+            this.removeListeners();
+            this.#reset();
+            return;
+        }
         this.quit = true;
     }
-    
-    async start({ wasmPath, canvasId }) {
-        if (this.wasm !== undefined) {
+
+    // renderer: "canvas2d" (default) or "webgl2". WebGL2 falls back to Canvas2D when it's not available.
+    // worker: run the module and all drawing in a dedicated Worker on an OffscreenCanvas, the page
+    // only forwards input events to it. Falls back to the main thread when that's not supported.
+    // maxFPS: cap the frame rate below whatever the game asks for with SetTargetFPS(), 0 for no cap.
+    // threadedWasmPath: the threads build, used instead of wasmPath when the page is cross-origin
+    // isolated, which SharedArrayBuffer requires.
+    // simdWasmPath: the SIMD128 build, used instead of wasmPath when the browser supports fixed-width
+    // SIMD. The threads build takes precedence when both apply.
+    // renderScale: canvas resolution as a fraction of the device pixels, e.g. 0.5 to trade sharpness
+    // for speed on 4K and retina displays. The game always sees the same logical (CSS pixel) size.
+    // hud: time the frames and imports and draw the numbers over the game, see PerfHud and exportTimings().
+    async start({ wasmPath, canvasId, renderer = "canvas2d", worker = false, maxFPS = 0, threadedWasmPath = undefined, simdWasmPath = undefined, renderScale = 1, hud = false }) {
+        if (this.wasm !== undefined || this.worker !== undefined) {
             console.error("The game is already running. Please stop() it first.");
             return;
         }
+        let threaded = false;
+        if (threadedWasmPath !== undefined) {
+            if (globalThis.crossOriginIsolated) {
+                wasmPath = threadedWasmPath;
+                threaded = true;
+            } else {
+                console.warn("The page is not cross-origin isolated, so there is no SharedArrayBuffer: running single-threaded");
+            }
+        }
+        if (simdWasmPath !== undefined && !threaded) {
+            if (wasm_simd_supported()) {
+                wasmPath = simdWasmPath;
+            } else {
+                console.warn("WebAssembly SIMD is not supported, running the baseline build");
+            }
+        }
+        console.log(`Running ${wasmPath}`);
 
         const canvas = document.getElementById(canvasId);
-        this.ctx = canvas.getContext("2d");
-        if (this.ctx === null) {
-            throw new Error("Could not create 2d canvas context");
+        this.element = canvas;
+        // Most games ask for a 0x0 window, this spares them a frame at the wrong size
+        RaylibJs.#styleCanvas(canvas, 0, 0);
+        this.viewport = {width: window.innerWidth, height: window.innerHeight, pixelRatio: window.devicePixelRatio || 1};
+        const offscreen = worker && RAYLIB_JS_URL !== undefined && typeof Worker !== "undefined" &&
+            typeof canvas.transferControlToOffscreen === "function";
+        if (worker && !offscreen) {
+            console.warn("OffscreenCanvas workers are not available, running on the main thread");
         }
 
-        this.wasm = await WebAssembly.instantiateStreaming(fetch(wasmPath), {
-            env: make_environment(this)
-        });
+        if (offscreen) {
+            const transferred = canvas.transferControlToOffscreen();
+            this.worker = new Worker(RAYLIB_JS_URL);
+            this.worker.onmessage = (e) => {
+                if (e.data.type === "title") document.title = e.data.title;
+                else if (e.data.type === "window") RaylibJs.#styleCanvas(canvas, e.data.width, e.data.height);
+                else if (e.data.type === "stats") this.stats = e.data.stats;
+            };
+            this.worker.postMessage({
+                type: "start",
+                canvas: transferred,
+                wasmPath: new URL(wasmPath, document.baseURI).href,
+                renderer,
+                maxFPS,
+                renderScale,
+                hud,
+                viewport: this.viewport,
+                fontUrl: new URL(GRIXEL_FONT_PATH, document.baseURI).href,
+            }, [transferred]);
+            this.#listen(canvas, (message) => this.worker.postMessage(message));
+        } else {
+            this.#listen(canvas, (message) => this.#input(message));
+            this.pacer.maxFPS = maxFPS;
+            this.renderScale = renderScale;
+            if (hud) this.hud = new PerfHud();
+            await this.#run(canvas, wasmPath, renderer);
+        }
+    }
 
-        const keyDown = (e) => {
-            this.currentPressedKeyState.add(glfwKeyMapping[e.code]);
+    // Entry point of the Worker started by start({worker: true}) and of the job workers, they load this very script
+    static serveWorker() {
+        const raylibJs = new RaylibJs();
+        self.onmessage = (e) => {
+            const message = e.data;
+            if (message.type === "jobs") {
+                RaylibJs.#serveJobs(message);
+            } else if (message.type === "start") {
+                raylibJs.viewport = message.viewport;
+                raylibJs.pacer.maxFPS = message.maxFPS;
+                raylibJs.renderScale = message.renderScale;
+                if (message.hud) raylibJs.hud = new PerfHud();
+                const font = new FontFace("grixel", `url(${message.fontUrl})`);
+                self.fonts.add(font);
+                font.load();
+                raylibJs.#run(message.canvas, message.wasmPath, message.renderer);
+            } else {
+                raylibJs.#input(message);
+            }
         };
-        const keyUp = (e) => {
-            this.currentPressedKeyState.delete(glfwKeyMapping[e.code]);
+    }
+
+    // Job worker of the threads build: the same module on the same memory,
+    // parked in jobs_worker_main() for good. Job code doesn't call imports
+    // besides rand(), so nothing else is provided.
+    static async #serveJobs({module, memory, stack}) {
+        const env = {
+            memory,
+            rand: () => Math.floor(Math.random() * 2147483647),
         };
-        const wheelMove = (e) => {
-          this.currentMouseWheelMoveState = Math.sign(-e.deltaY);
+        const instance = await WebAssembly.instantiate(module, make_environment(module, env, false));
+        // Nothing may run before this, it would use the main thread's stack
+        instance.exports.__stack_pointer.value = stack;
+        instance.exports.jobs_worker_main();
+    }
+
+    // Workers for jobs.h, one per core besides this thread, as many as the module has stacks for
+    #startJobWorkers(module) {
+        const exports = this.wasm.instance.exports;
+        const cores = typeof navigator !== "undefined" && navigator.hardwareConcurrency ? navigator.hardwareConcurrency : 1;
+        for (let i = 0; i < cores - 1; ++i) {
+            const stack = exports.jobs_worker_stack(i);
+            if (stack === 0) break;
+            const worker = new Worker(RAYLIB_JS_URL);
+            worker.postMessage({type: "jobs", module, memory: this.memory, stack});
+            this.jobWorkers.push(worker);
+        }
+        console.log(`Started ${this.jobWorkers.length} job workers`);
+    }
+
+    // Turns DOM events into plain input messages, which go either straight to
+    // #input() or to the worker. Mouse positions are made canvas relative here,
+    // with the canvas rectangle cached until something could have moved it.
+    #listen(canvas, send) {
+        let rect = undefined;
+        const canvasRect = () => {
+            if (rect === undefined) rect = canvas.getBoundingClientRect();
+            return rect;
         };
+        const keyDown = (e) => send({type: "keydown", code: e.code});
+        const keyUp = (e) => send({type: "keyup", code: e.code});
+        const wheelMove = (e) => send({type: "wheel", deltaY: e.deltaY});
         const mouseMove = (e) => {
-            this.prevMousePosition = this.currentMousePosition;
-            this.currentMousePosition = {x: e.clientX, y: e.clientY};
+            const {left, top} = canvasRect();
+            send({type: "mousemove", x: e.clientX - left, y: e.clientY - top});
         };
-        const mouseDown = (e) => {
-            this.currentMouseButtonState.add(glfwMouseButtonMapping[e.button]);
+        const mouseDown = (e) => send({type: "mousedown", button: e.button});
+        const mouseUp = (e) => send({type: "mouseup", button: e.button});
+        // Window resizes and scrolling can move the canvas without resizing it
+        const moved = (e) => {
+            rect = undefined;
         };
-        const mouseUp = (e) => {
-            this.currentMouseButtonState.delete(glfwMouseButtonMapping[e.button]);
-        };
-        const fullScreen = (e) => {
-            this.ctx.canvas.width  = window.innerWidth;
-            this.ctx.canvas.height = window.innerHeight;
+        // The canvas CSS box is the logical screen, its device pixel box (where supported,
+        // it also changes with the zoom or when the window moves to another display) the
+        // most the canvas resolution needs to be
+        const resized = (entries) => {
+            rect = undefined;
+            const entry = entries[entries.length - 1];
+            const css = entry.contentBoxSize[0];
+            const device = entry.devicePixelContentBoxSize !== undefined ? entry.devicePixelContentBoxSize[0] : undefined;
+            if (css.inlineSize <= 0 || css.blockSize <= 0) return;
+            send({
+                type: "viewport",
+                width: css.inlineSize,
+                height: css.blockSize,
+                pixelRatio: device !== undefined ? device.inlineSize/css.inlineSize : window.devicePixelRatio || 1,
+            });
         };
+        const observer = typeof ResizeObserver === "function" ? new ResizeObserver(resized) : undefined;
+        if (observer !== undefined) {
+            try {
+                observer.observe(canvas, {box: "device-pixel-content-box"});
+            } catch (e) {
+                observer.observe(canvas);
+            }
+        }
         window.addEventListener("keydown", keyDown);
         window.addEventListener("keyup", keyUp);
         window.addEventListener("wheel", wheelMove);
         window.addEventListener("mousemove", mouseMove);
         window.addEventListener("mousedown", mouseDown);
         window.addEventListener("mouseup", mouseUp);
-        this.ctx.canvas.addEventListener("fullscreenchange", fullScreen);
+        window.addEventListener("resize", moved);
+        window.addEventListener("scroll", moved, true);
+        this.removeListeners = () => {
+            window.removeEventListener("keydown", keyDown);
+            window.removeEventListener("keyup", keyUp);
+            window.removeEventListener("wheel", wheelMove);
+            window.removeEventListener("mousemove", mouseMove);
+            window.removeEventListener("mousedown", mouseDown);
+            window.removeEventListener("mouseup", mouseUp);
+            window.removeEventListener("resize", moved);
+            window.removeEventListener("scroll", moved, true);
+            if (observer !== undefined) observer.disconnect();
+        };
+    }
+
+    #input(message) {
+        switch (message.type) {
+        case "keydown": {
+            const key = glfwKeyMapping[message.code];
+            if (key === undefined) break;
+            // Auto repeat sends more keydowns for a key that is already down
+            if (!test_bit(this.keysDown, key)) set_bit(this.keysPressed, key);
+            set_bit(this.keysDown, key);
+        } break;
+        case "keyup": {
+            const key = glfwKeyMapping[message.code];
+            if (key !== undefined) clear_bit(this.keysDown, key);
+        } break;
+        case "wheel":
+            this.wheel = Math.sign(-message.deltaY);
+            break;
+        case "mousemove":
+            this.mouseX = message.x;
+            this.mouseY = message.y;
+            break;
+        case "mousedown": {
+            const button = glfwMouseButtonMapping[message.button];
+            if (button === undefined) break;
+            this.buttonsPressed |= 1 << button;
+            this.buttonsDown |= 1 << button;
+        } break;
+        case "mouseup": {
+            const button = glfwMouseButtonMapping[message.button];
+            if (button !== undefined) this.buttonsDown &= ~(1 << button);
+        } break;
+        case "viewport":
+            // Until InitWindow() sized the canvas its box means nothing, 0x0 windows get the window size
+            this.viewport.pixelRatio = message.pixelRatio;
+            if (this.screenWidth > 0) this.#resize(message.width, message.height);
+            break;
+        }
+    }
+
+    // Size the canvas element from the page, the ResizeObserver in #listen() takes it from there.
+    // A 0 size fills the window, which is also what fullscreen does.
+    static #styleCanvas(canvas, width, height) {
+        canvas.style.width = width > 0 ? `${width}px` : "100vw";
+        canvas.style.height = height > 0 ? `${height}px` : "100vh";
+    }
 
+    // The game draws in logical pixels, the canvas has pixelRatio times as
+    // many, scaled by the context transform (or the WebGL2 renderer). Modules
+    // that blit their own frame keep one canvas pixel per logical pixel.
+    #resize(width, height) {
+        const ratio = this.blits ? 1 : this.viewport.pixelRatio*this.renderScale;
+        const pixelWidth = Math.max(1, Math.round(width*ratio));
+        const pixelHeight = Math.max(1, Math.round(height*ratio));
+        this.screenWidth = width;
+        this.screenHeight = height;
+        if (this.canvas.width !== pixelWidth || this.canvas.height !== pixelHeight) {
+            this.canvas.width = pixelWidth;
+            this.canvas.height = pixelHeight;
+        }
+        this.pixelRatio = pixelWidth/width;
+        this.state.setScale(this.pixelRatio);
+        if (this.gl !== undefined) this.gl.setScale(this.pixelRatio);
+    }
+
+    // Creates the context on the canvas (a DOM canvas or an OffscreenCanvas), instantiates the module and runs the frame loop
+    async #run(canvas, wasmPath, renderer) {
+        this.canvas = canvas;
+        // Text goes through an OffscreenCanvas overlay. Checked before a WebGL2
+        // context exists, a canvas that has one can't give out a 2d context anymore.
+        if (renderer === "webgl2" && typeof OffscreenCanvas === "undefined") {
+            console.warn("WebGL2 needs OffscreenCanvas for text, falling back to Canvas2D");
+        } else if (renderer === "webgl2") {
+            const gl = this.canvas.getContext("webgl2", {
+                antialias: false,
+                premultipliedAlpha: true,
+                // Trails fade the previous frame instead of clearing it
+                preserveDrawingBuffer: true,
+            });
+            if (gl !== null) {
+                this.gl = new WebGL2Renderer(gl);
+                this.ctx = this.gl.overlay;
+            } else {
+                console.warn("WebGL2 is not available, falling back to Canvas2D");
+            }
+        }
+        if (this.gl === undefined) {
+            this.ctx = this.canvas.getContext("2d");
+            if (this.ctx === null) {
+                throw new Error("Could not create 2d canvas context");
+            }
+        }
+        this.state = new CanvasState(this.ctx);
+
+        const started = performance.now();
+        const {module, source} = await compile_module(wasmPath);
+        const compiled = performance.now();
+        this.blits = WebAssembly.Module.imports(module).some(({name}) => name === "raylib_js_blit");
+        const threaded = WebAssembly.Module.exports(module).some(({name}) => name === "jobs_worker_main");
+        if (threaded) {
+            this.memory = new WebAssembly.Memory({
+                initial: THREADS_MEMORY_INITIAL,
+                maximum: THREADS_MEMORY_MAXIMUM,
+                shared: true,
+            });
+        }
+        const imports = make_environment(module, this);
+        if (this.hud !== undefined) this.hud.instrument(imports);
+        const instance = await WebAssembly.instantiate(module, imports);
+        this.wasm = {module, instance};
+        this.wasmPath = wasmPath;
+        if (this.memory === undefined) this.memory = instance.exports.memory;
+        if (threaded) this.#startJobWorkers(module);
 
         this.wasm.instance.exports.main();
+        let firstFrame = true;
         const next = (timestamp) => {
             if (this.quit) {
-                this.ctx.clearRect(0, 0, this.ctx.canvas.width, this.ctx.canvas.height);
-                window.removeEventListener("keydown", keyDown);
+                for (const worker of this.jobWorkers) worker.terminate();
+                if (this.gl !== undefined) this.gl.dispose();
+                else this.ctx.clearRect(0, 0, this.canvas.width, this.canvas.height);
+                if (this.removeListeners !== undefined) this.removeListeners();
                 this.#reset()
                 return;
             }
-            this.dt = (timestamp - this.previous)/1000.0;
-            this.previous = timestamp;
-            this.entryFunction();
-            window.requestAnimationFrame(next);
+            const dt = this.pacer.tick(timestamp);
+            if (dt !== undefined) {
+                this.step(dt);
+                if (firstFrame) {
+                    firstFrame = false;
+                    this.startup = {
+                        source,
+                        compileMs: compiled - started,
+                        firstFrameMs: performance.now() - started,
+                    };
+                    console.log(`First frame after ${this.startup.firstFrameMs.toFixed(1)} ms, module compiled in ${this.startup.compileMs.toFixed(1)} ms (${source})`);
+                }
+                if (this.pacer.measured && typeof document === "undefined") {
+                    self.postMessage({type: "stats", stats: {...this.frameStats(), timings: this.exportTimings()}});
+                }
+            }
+            requestFrame(next);
         };
-        window.requestAnimationFrame((timestamp) => {
-            this.previous = timestamp;
-            window.requestAnimationFrame(next);
+        requestFrame((timestamp) => {
+            this.pacer.reset(timestamp);
+            requestFrame(next);
         });
     }
-    
-    GetMouseDelta(result_ptr) {
-        const bcrect = this.ctx.canvas.getBoundingClientRect();
-        const cur_x = this.currentMousePosition.x - bcrect.left;
-        const cur_y = this.currentMousePosition.y - bcrect.top;
-        
-        const prev_x = this.prevMousePosition.x - bcrect.left;
-        const prev_y = this.prevMousePosition.y - bcrect.top;
 
-        const dx = cur_x - prev_x;
-        const dy = cur_y - prev_y;
+    // Measured frame rate and pacing counters, see FramePacer. With a worker
+    // these are the ones it last posted, about once a second.
+    frameStats() {
+        if (this.worker !== undefined) return this.stats;
+        const pacer = this.pacer;
+        return {
+            targetFPS: pacer.rate(),
+            fps: pacer.fps,
+            frames: pacer.frames,
+            skipped: pacer.skipped,
+            dropped: pacer.dropped,
+            startup: this.startup,
+            // Linear memory grows with the module's heap (src/heap.h) and never shrinks
+            memoryBytes: this.memory !== undefined ? this.memory.buffer.byteLength : 0,
+        };
+    }
 
-        const buffer = this.wasm.instance.exports.memory.buffer;
-        new Float32Array(buffer, result_ptr, 2).set([dx, dy]);
+    // What the HUD measured over the last few seconds plus the setup it ran in, as plain
+    // data for JSON.stringify(), so a report from the field comes with numbers.
+    // undefined without start({hud: true}). With a worker it's what it last posted.
+    exportTimings() {
+        if (this.worker !== undefined) return this.stats !== undefined ? this.stats.timings : undefined;
+        if (this.hud === undefined) return undefined;
+        const stats = this.frameStats();
+        return {
+            wasmPath: this.wasmPath,
+            renderer: this.gl !== undefined ? "webgl2" : this.blits ? "software" : "canvas2d",
+            userAgent: typeof navigator !== "undefined" ? navigator.userAgent : undefined,
+            screen: {width: this.screenWidth, height: this.screenHeight, pixelRatio: this.pixelRatio},
+            fps: stats.fps,
+            targetFPS: stats.targetFPS,
+            dropped: stats.dropped,
+            memoryBytes: stats.memoryBytes,
+            startup: stats.startup,
+            ...this.hud.report(),
+        };
+    }
+
+    // Runs one frame with the given frame time, after applying input messages
+    // (the ones #listen() sends). The frame loop uses it, and so does
+    // js/bench.js to drive the module without a browser.
+    step(dt, messages = []) {
+        for (const message of messages) this.#input(message);
+        this.dt = dt;
+        this.#snapshotInput();
+        if (this.hud !== undefined) {
+            this.hud.beginFrame();
+            this.entryFunction();
+            this.hud.endFrame();
+        } else {
+            this.entryFunction();
+        }
+    }
+
+    // Freeze the input for the coming frame. Presses are latched until here,
+    // so a click shorter than a frame is still seen. Modules that registered
+    // an InputSnapshot get a copy in their memory and never have to ask.
+    #snapshotInput() {
+        const frame = this.frame;
+        frame.deltaX = this.mouseX - frame.mouseX;
+        frame.deltaY = this.mouseY - frame.mouseY;
+        frame.mouseX = this.mouseX;
+        frame.mouseY = this.mouseY;
+        frame.wheel = this.wheel;
+        frame.buttonsDown = this.buttonsDown;
+        frame.buttonsPressed = this.buttonsPressed;
+        frame.keysDown.set(this.keysDown);
+        frame.keysPressed.set(this.keysPressed);
+        this.wheel = 0;
+        this.buttonsPressed = 0;
+        this.keysPressed.fill(0);
+        if (this.inputPtr !== undefined) this.#writeInput();
+    }
+
+    // Layout of InputSnapshot in src/balls.c
+    #writeInput() {
+        this.#heap();
+        const frame = this.frame;
+        const f32 = this.HEAPF32;
+        const u32 = this.HEAPU32;
+        const base = this.inputPtr>>2;
+        f32[base + 0] = frame.mouseX;
+        f32[base + 1] = frame.mouseY;
+        f32[base + 2] = frame.deltaX;
+        f32[base + 3] = frame.deltaY;
+        f32[base + 4] = frame.wheel;
+        u32[base + 5] = this.screenWidth;
+        u32[base + 6] = this.screenHeight;
+        u32[base + 7] = frame.buttonsDown;
+        u32[base + 8] = frame.buttonsPressed;
+        u32.set(frame.keysDown, base + 9);
+        u32.set(frame.keysPressed, base + 9 + INPUT_KEY_WORDS);
+    }
+
+    raylib_js_set_input(input_ptr) {
+        this.inputPtr = input_ptr;
+    }
+
+    GetMouseDelta(result_ptr) {
+        this.#heap();
+        this.HEAPF32[result_ptr>>2] = this.frame.deltaX;
+        this.HEAPF32[(result_ptr>>2) + 1] = this.frame.deltaY;
     }
 
     CheckCollisionCircles(center1_ptr, radius1, center2_ptr, radius2) {
-        const buffer = this.wasm.instance.exports.memory.buffer;
-        const [x1, y1] = new Float32Array(buffer, center1_ptr, 2);
-        const [x2, y2] = new Float32Array(buffer, center2_ptr, 2);
+        this.#heap();
+        const x1 = this.HEAPF32[center1_ptr>>2], y1 = this.HEAPF32[(center1_ptr>>2) + 1];
+        const x2 = this.HEAPF32[center2_ptr>>2], y2 = this.HEAPF32[(center2_ptr>>2) + 1];
         
         var collision = false;
 
@@ -161,9 +700,9 @@ class RaylibJs {
     }
 
     CheckCollisionPointRect(point_ptr, rec_ptr) {
-        const buffer = this.wasm.instance.exports.memory.buffer;
-        const [point_x, point_y] = new Float32Array(buffer, point_ptr, 2);
-        const [rec_x, rec_y, rec_w, rec_h] = new Float32Array(buffer, rec_ptr, 4);
+        this.#heap();
+        const point_x = this.HEAPF32[point_ptr>>2], point_y = this.HEAPF32[(point_ptr>>2) + 1];
+        const rec_x = this.HEAPF32[rec_ptr>>2], rec_y = this.HEAPF32[(rec_ptr>>2) + 1], rec_w = this.HEAPF32[(rec_ptr>>2) + 2], rec_h = this.HEAPF32[(rec_ptr>>2) + 3];
 
         var collision = false;
 
@@ -177,18 +716,13 @@ class RaylibJs {
     }
 
     InitWindow(width, height, title_ptr) {
-        if (width === 0) {
-            this.ctx.canvas.width  = window.innerWidth;
-        } else {
-            this.ctx.canvas.width = width;
-        }
-        if (height === 0) { 
-            this.ctx.canvas.height = window.innerHeight;
-        } else { 
-            this.ctx.canvas.height = height;
-        }
-        const buffer = this.wasm.instance.exports.memory.buffer;
-        document.title = cstr_by_ptr(buffer, title_ptr);
+        this.#resize(width > 0 ? width : this.viewport.width, height > 0 ? height : this.viewport.height);
+        if (this.element !== undefined) RaylibJs.#styleCanvas(this.element, width, height);
+        else if (typeof WorkerGlobalScope !== "undefined") self.postMessage({type: "window", width, height});
+        this.#heap();
+        const title = cstr_by_ptr(this.HEAPU8, title_ptr);
+        if (typeof document !== "undefined") document.title = title;
+        else if (typeof WorkerGlobalScope !== "undefined") self.postMessage({type: "title", title});
     }
 
     WindowShouldClose(){
@@ -196,136 +730,210 @@ class RaylibJs {
     }
 
     SetTargetFPS(fps) {
-        console.log(`The game wants to run at ${fps} FPS, but in Web we gonna just ignore it.`);
-        this.targetFPS = fps;
+        this.pacer.targetFPS = fps;
+    }
+
+    GetFPS() {
+        return Math.round(this.pacer.fps);
     }
 
     GetScreenWidth() {
-        return this.ctx.canvas.width;
+        return this.screenWidth;
     }
 
     GetScreenHeight() {
-        return this.ctx.canvas.height;
+        return this.screenHeight;
     }
 
     GetFrameTime() {
-        // TODO: This is a stopgap solution to prevent sudden jumps in dt when the user switches to a differen tab.
-        // We need a proper handling of Target FPS here.
-        return Math.min(this.dt, 1.0/this.targetFPS);
+        return this.dt;
+    }
+
+    // Views over the wasm memory, rebuilt only when memory.grow() replaced the buffer.
+    // The module grows memory from its allocator in the middle of a frame, which
+    // detaches the old buffer, so every import that touches memory starts here and
+    // nothing keeps a view across calls into wasm.
+    #heap() {
+        const buffer = this.memory.buffer;
+        if (this.HEAPU8 !== undefined && this.HEAPU8.buffer === buffer) return;
+        this.HEAPU8 = new Uint8Array(buffer);
+        this.HEAPU32 = new Uint32Array(buffer);
+        this.HEAPF32 = new Float32Array(buffer);
+        this.HEAPVIEW = new DataView(buffer);
     }
 
     BeginDrawing() {}
 
     EndDrawing() {
-        this.prevMousePosition = this.currentMousePosition;
-        this.prevMouseButtonState.clear();
-        this.prevMouseButtonState = new Set(this.currentMouseButtonState);
-        this.prevPressedKeyState.clear();
-        this.prevPressedKeyState = new Set(this.currentPressedKeyState);
-        this.currentMouseWheelMoveState = 0.0;
+        this.#drawCommands();
+        this.#present();
     }
 
-    DrawCircleV(center_ptr, radius, color_ptr) {
-        const buffer = this.wasm.instance.exports.memory.buffer;
-        const [x, y] = new Float32Array(buffer, center_ptr, 2);
-        const [r, g, b, a] = new Uint8Array(buffer, color_ptr, 4);
-        const color = color_hex_unpacked(r, g, b, a);
+    // Drawing primitives shared by the imports and the command buffer. Colors
+    // are packed RGBA u32 with red in the low byte. With WebGL2 circles and
+    // rectangles are batched on the GPU, everything else goes through the 2D
+    // overlay returned by #canvas2d().
+    #canvas2d() {
+        // Resizing a canvas resets its context state
+        if (this.gl !== undefined && this.gl.beginOverlay()) this.state.invalidate();
+        this.circles.flush(this.state);
+        return this.state;
+    }
+
+    #clear(color) {
+        if (this.gl !== undefined) {
+            this.gl.clear(color);
+            return;
+        }
+        // Whatever is batched would be covered anyway
+        this.circles.discard();
+        this.state.fillColor(color);
+        this.ctx.fillRect(0, 0, this.screenWidth, this.screenHeight);
+    }
+
+    #fillRect(x, y, w, h, color) {
+        if (this.gl !== undefined) {
+            this.gl.rect(x, y, w, h, color);
+            return;
+        }
+        this.circles.flush(this.state);
+        this.state.fillColor(color);
+        this.ctx.fillRect(x, y, w, h);
+    }
+
+    #fillCircle(x, y, radius, color) {
+        if (this.gl !== undefined) {
+            this.gl.circle(x, y, radius, color, color);
+            return;
+        }
+        this.circles.add(x, y, radius, color);
+    }
+
+    #fillCircleGradient(x, y, radius, color, color2) {
+        if (this.gl !== undefined) {
+            this.gl.circle(x, y, radius, color, color2);
+            return;
+        }
+        this.circles.flush(this.state);
+        // Sprites are rendered at the canvas resolution, for the next whole radius there
+        const pixelRadius = radius*this.pixelRatio;
+        const sprite = this.gradientSprites.get(pixelRadius, color, color2);
+        if (sprite !== undefined) {
+            const half = sprite.width/2*radius/Math.ceil(pixelRadius);
+            this.ctx.drawImage(sprite, x - half, y - half, 2*half, 2*half);
+            return;
+        }
         this.ctx.beginPath();
-        this.ctx.arc(x, y, radius, 0, 2*Math.PI, false);
-        this.ctx.fillStyle = color;
+        this.ctx.arc(x, y, radius, 0, Math.PI*2, false);
+        this.state.fillGradient(radial_gradient(this.ctx, x, y, radius, color, color2));
         this.ctx.fill();
     }
 
+    // Takes the C string pointer rather than the text, so labels that are
+    // drawn every frame skip the decoding as well as the glyph rasterization
+    #fillText(text_ptr, posX, posY, fontSize, color) {
+        const entry = this.textLabels.intern(this.HEAPU8, text_ptr);
+        const ratio = this.pixelRatio;
+        const label = this.textLabels.label(entry, fontSize*this.#FONT_SCALE_MAGIC*ratio, "grixel", color);
+        if (label !== undefined) {
+            // Labels are rendered at the canvas resolution and placed on whole canvas pixels
+            const x = (Math.round(posX*ratio) - TextLabels.PADDING)/ratio;
+            const y = (Math.round(posY*ratio) - TextLabels.PADDING)/ratio;
+            const w = label.width/ratio, h = label.height/ratio;
+            if (this.gl !== undefined) {
+                this.gl.image(label, x, y, w, h);
+            } else {
+                this.circles.flush(this.state);
+                this.ctx.drawImage(label, x, y, w, h);
+            }
+            return;
+        }
+
+        const state = this.#canvas2d();
+        fontSize *= this.#FONT_SCALE_MAGIC;
+        state.fillColor(color);
+        // TODO: since the default font is part of Raylib the css that defines it should be located in raylib.js and not in index.html
+        state.font(fontSize, "grixel");
+
+        const lines = entry.text.split('\n');
+        for (var i = 0; i < lines.length; i++) {
+            state.ctx.fillText(lines[i], posX, posY + fontSize + (i * fontSize));
+        }
+    }
+
+    DrawCircleV(center_ptr, radius, color_ptr) {
+        this.#heap();
+        const x = this.HEAPF32[center_ptr>>2], y = this.HEAPF32[(center_ptr>>2) + 1];
+        this.#fillCircle(x, y, radius, this.HEAPVIEW.getUint32(color_ptr, true));
+    }
+
     DrawCircleLinesV(center_ptr, radius, color_ptr) {
-        const buffer = this.wasm.instance.exports.memory.buffer;
-        const [x, y] = new Float32Array(buffer, center_ptr, 2);
-        const [r, g, b, a] = new Uint8Array(buffer, color_ptr, 4);
-        const color = color_hex_unpacked(r, g, b, a);
-        this.ctx.beginPath();
-        this.ctx.arc(x, y, radius, 0, 2*Math.PI, false);
-        this.ctx.strokeStyle = color;
-        this.ctx.lineWidth = 1;
-        this.ctx.stroke();
+        this.#heap();
+        const x = this.HEAPF32[center_ptr>>2], y = this.HEAPF32[(center_ptr>>2) + 1];
+        const state = this.#canvas2d();
+        state.ctx.beginPath();
+        state.ctx.arc(x, y, radius, 0, 2*Math.PI, false);
+        state.strokeColor(this.HEAPVIEW.getUint32(color_ptr, true));
+        state.lineWidth(1);
+        state.ctx.stroke();
     }
 
     DrawRing(center_ptr, inner_radius, outer_radius, start_angle, end_agnle, segments, color_ptr) {
-        const buffer = this.wasm.instance.exports.memory.buffer;
-        const [x, y] = new Float32Array(buffer, center_ptr, 2);
-        const [r, g, b, a] = new Uint8Array(buffer, color_ptr, 4);
-        const color = color_hex_unpacked(r, g, b, a); 
+        this.#heap();
+        const x = this.HEAPF32[center_ptr>>2], y = this.HEAPF32[(center_ptr>>2) + 1];
         const radius_delta = outer_radius - inner_radius;
         const radius = inner_radius + radius_delta/2; 
-        this.ctx.beginPath();
-        this.ctx.arc(x, y, radius, start_angle, end_agnle, false);
-        this.ctx.strokeStyle = color;
-        this.ctx.lineWidth = radius_delta;
-        this.ctx.stroke();
+        const state = this.#canvas2d();
+        state.ctx.beginPath();
+        state.ctx.arc(x, y, radius, start_angle, end_agnle, false);
+        state.strokeColor(this.HEAPVIEW.getUint32(color_ptr, true));
+        state.lineWidth(radius_delta);
+        state.ctx.stroke();
     }
 
 
     DrawCircleGradient(x, y, radius, color_ptr, color2_ptr) {
-        const buffer = this.wasm.instance.exports.memory.buffer;
-        const [r, g, b, a] = new Uint8Array(buffer, color_ptr, 4);
-        const [r2, g2, b2, a2] = new Uint8Array(buffer, color2_ptr, 4);
-        const color = color_hex_unpacked(r, g, b, a); 
-        const color2 = color_hex_unpacked(r2, g2, b2, a2); 
-        // Create a radial gradient
-        const gradient = this.ctx.createRadialGradient(x, y, radius/2, x, y, radius);
-        gradient.addColorStop(0, color);
-        gradient.addColorStop(0.5, color2);
-        this.ctx.beginPath();
-        this.ctx.arc(x, y, radius, 0, Math.PI*2, false);
-        this.ctx.fillStyle = gradient;
-        this.ctx.fill();
+        this.#heap();
+        const color = this.HEAPVIEW.getUint32(color_ptr, true);
+        const color2 = this.HEAPVIEW.getUint32(color2_ptr, true);
+        this.#fillCircleGradient(x, y, radius, color, color2);
     } 
 
     ClearBackground(color_ptr) {
-        this.ctx.fillStyle = getColorFromMemory(this.wasm.instance.exports.memory.buffer, color_ptr);
-        this.ctx.fillRect(0, 0, this.ctx.canvas.width, this.ctx.canvas.height);
+        this.#heap();
+        this.#clear(this.HEAPVIEW.getUint32(color_ptr, true));
     }
 
     // RLAPI void DrawText(const char *text, int posX, int posY, int fontSize, Color color);       // Draw text (using default font)
     DrawText(text_ptr, posX, posY, fontSize, color_ptr) {
-        const buffer = this.wasm.instance.exports.memory.buffer;
-        const text = cstr_by_ptr(buffer, text_ptr);
-        const color = getColorFromMemory(buffer, color_ptr);
-        fontSize *= this.#FONT_SCALE_MAGIC;
-        this.ctx.fillStyle = color;
-        // TODO: since the default font is part of Raylib the css that defines it should be located in raylib.js and not in index.html
-        this.ctx.font = `${fontSize}px grixel`;
-
-        const lines = text.split('\n');
-        for (var i = 0; i < lines.length; i++) {
-            this.ctx.fillText(lines[i], posX, posY + fontSize + (i * fontSize));
-        }
+        this.#heap();
+        this.#fillText(text_ptr, posX, posY, fontSize, this.HEAPVIEW.getUint32(color_ptr, true));
     }
 
     // RLAPI void DrawRectangle(int posX, int posY, int width, int height, Color color);                        // Draw a color-filled rectangle
     DrawRectangle(posX, posY, width, height, color_ptr) {
-        const buffer = this.wasm.instance.exports.memory.buffer;
-        const color = getColorFromMemory(buffer, color_ptr);
-        this.ctx.fillStyle = color;
-        this.ctx.fillRect(posX, posY, width, height);
+        this.#heap();
+        this.#fillRect(posX, posY, width, height, this.HEAPVIEW.getUint32(color_ptr, true));
     }
     
     IsMouseButtonPressed(key) {
-        return !this.prevMouseButtonState.has(key) && this.currentMouseButtonState.has(key);
+        return key >= 0 && key < 32 && (this.frame.buttonsPressed & (1 << key)) !== 0;
     }
 
     IsMouseButtonDown(key) {
-        return this.currentMouseButtonState.has(key);
+        return key >= 0 && key < 32 && (this.frame.buttonsDown & (1 << key)) !== 0;
     }
 
     IsKeyPressed(key) {
-        return !this.prevPressedKeyState.has(key) && this.currentPressedKeyState.has(key);
+        return test_bit(this.frame.keysPressed, key);
     }
 
     IsKeyDown(key) {
-        return this.currentPressedKeyState.has(key);
+        return test_bit(this.frame.keysDown, key);
     }
 
     GetMouseWheelMove() {
-      return this.currentMouseWheelMoveState;
+      return this.frame.wheel;
     }
 
     IsGestureDetected() {
@@ -339,8 +947,8 @@ class RaylibJs {
 
     TraceLog(logLevel, text_ptr, ... args) {
         // TODO: Implement printf style formatting for TraceLog
-        const buffer = this.wasm.instance.exports.memory.buffer;
-        const text = cstr_by_ptr(buffer, text_ptr);
+        this.#heap();
+        const text = cstr_by_ptr(this.HEAPU8, text_ptr);
         switch(logLevel) {
         case LOG_ALL:     console.log(`ALL: ${text} ${args}`);     break;
         case LOG_TRACE:   console.log(`TRACE: ${text} ${args}`);   break;
@@ -354,113 +962,115 @@ class RaylibJs {
     }
 
     GetMousePosition(result_ptr) {
-        const bcrect = this.ctx.canvas.getBoundingClientRect();
-        const x = this.currentMousePosition.x - bcrect.left;
-        const y = this.currentMousePosition.y - bcrect.top;
+        const x = this.frame.mouseX;
+        const y = this.frame.mouseY;
 
-        const buffer = this.wasm.instance.exports.memory.buffer;
-        new Float32Array(buffer, result_ptr, 2).set([x, y]);
+        this.#heap();
+        this.HEAPF32[result_ptr>>2] = x;
+        this.HEAPF32[(result_ptr>>2) + 1] = y;
     }
 
     CheckCollisionPointRec(point_ptr, rec_ptr) {
-        const buffer = this.wasm.instance.exports.memory.buffer;
-        const [x, y] = new Float32Array(buffer, point_ptr, 2);
-        const [rx, ry, rw, rh] = new Float32Array(buffer, rec_ptr, 4);
+        this.#heap();
+        const x = this.HEAPF32[point_ptr>>2], y = this.HEAPF32[(point_ptr>>2) + 1];
+        const rx = this.HEAPF32[rec_ptr>>2], ry = this.HEAPF32[(rec_ptr>>2) + 1], rw = this.HEAPF32[(rec_ptr>>2) + 2], rh = this.HEAPF32[(rec_ptr>>2) + 3];
         return ((x >= rx) && x <= (rx + rw) && (y >= ry) && y <= (ry + rh));
     }
 
     Fade(result_ptr, color_ptr, alpha) {
-        const buffer = this.wasm.instance.exports.memory.buffer;
-        const [r, g, b, _] = new Uint8Array(buffer, color_ptr, 4);
+        this.#heap();
+        const r = this.HEAPU8[color_ptr], g = this.HEAPU8[color_ptr + 1], b = this.HEAPU8[color_ptr + 2];
         const newA = Math.max(0, Math.min(255, 255.0*alpha));
-        new Uint8Array(buffer, result_ptr, 4).set([r, g, b, newA]);
+        this.HEAPU8[result_ptr] = r;
+        this.HEAPU8[result_ptr + 1] = g;
+        this.HEAPU8[result_ptr + 2] = b;
+        this.HEAPU8[result_ptr + 3] = newA;
     }
 
     ColorAlpha(result_ptr, color_ptr, alpha) {
-        const buffer = this.wasm.instance.exports.memory.buffer;
-        const [r, g, b, _] = new Uint8Array(buffer, color_ptr, 4);
+        this.#heap();
+        const r = this.HEAPU8[color_ptr], g = this.HEAPU8[color_ptr + 1], b = this.HEAPU8[color_ptr + 2];
 
         if (alpha < 0.0) alpha = 0.0;
         else if (alpha > 1.0) alpha = 1.0;
 
         const newA = 255*alpha;
 
-        new Uint8Array(buffer, result_ptr, 4).set([r, g, b, newA]);
+        this.HEAPU8[result_ptr] = r;
+        this.HEAPU8[result_ptr + 1] = g;
+        this.HEAPU8[result_ptr + 2] = b;
+        this.HEAPU8[result_ptr + 3] = newA;
     }
 
     DrawRectangleRec(rec_ptr, color_ptr) {
-        const buffer = this.wasm.instance.exports.memory.buffer;
-        const [x, y, w, h] = new Float32Array(buffer, rec_ptr, 4);
-        const color = getColorFromMemory(buffer, color_ptr);
-        this.ctx.fillStyle = color;
-        this.ctx.fillRect(x, y, w, h);
+        this.#heap();
+        const x = this.HEAPF32[rec_ptr>>2], y = this.HEAPF32[(rec_ptr>>2) + 1], w = this.HEAPF32[(rec_ptr>>2) + 2], h = this.HEAPF32[(rec_ptr>>2) + 3];
+        this.#fillRect(x, y, w, h, this.HEAPVIEW.getUint32(color_ptr, true));
     }
 
     DrawRectangleLinesEx(rec_ptr, lineThick, color_ptr) {
-        const buffer = this.wasm.instance.exports.memory.buffer;
-        const [x, y, w, h] = new Float32Array(buffer, rec_ptr, 4);
-        const color = getColorFromMemory(buffer, color_ptr);
-        this.ctx.strokeStyle = color;
-        this.ctx.lineWidth = lineThick;
-        this.ctx.strokeRect(x + lineThick/2, y + lineThick/2, w - lineThick, h - lineThick);
+        this.#heap();
+        const x = this.HEAPF32[rec_ptr>>2], y = this.HEAPF32[(rec_ptr>>2) + 1], w = this.HEAPF32[(rec_ptr>>2) + 2], h = this.HEAPF32[(rec_ptr>>2) + 3];
+        const state = this.#canvas2d();
+        state.strokeColor(this.HEAPVIEW.getUint32(color_ptr, true));
+        state.lineWidth(lineThick);
+        state.ctx.strokeRect(x + lineThick/2, y + lineThick/2, w - lineThick, h - lineThick);
     }
 
     MeasureText(text_ptr, fontSize) {
-        const buffer = this.wasm.instance.exports.memory.buffer;
-        const text = cstr_by_ptr(buffer, text_ptr);
+        this.#heap();
+        const text = cstr_by_ptr(this.HEAPU8, text_ptr);
         fontSize *= this.#FONT_SCALE_MAGIC;
-        this.ctx.font = `${fontSize}px grixel`;
+        this.state.font(fontSize, "grixel");
         return this.ctx.measureText(text).width;
     }
 
     TextSubtext(text_ptr, position, length) {
-        const buffer = this.wasm.instance.exports.memory.buffer;
-        const text = cstr_by_ptr(buffer, text_ptr);
+        this.#heap();
+        const text = cstr_by_ptr(this.HEAPU8, text_ptr);
         const subtext = text.substring(position, length);
 
-        var bytes = new Uint8Array(buffer, 0, subtext.length+1);
+        const bytes = this.HEAPU8;
         for(var i = 0; i < subtext.length; i++) {
             bytes[i] = subtext.charCodeAt(i);
         }
         bytes[subtext.length] = 0;
 
-        return bytes;
+        return 0;
     }
 
     // RLAPI Texture2D LoadTexture(const char *fileName);
     LoadTexture(result_ptr, filename_ptr) {
-        const buffer = this.wasm.instance.exports.memory.buffer;
-        const filename = cstr_by_ptr(buffer, filename_ptr);
+        this.#heap();
+        const filename = cstr_by_ptr(this.HEAPU8, filename_ptr);
 
-        var result = new Uint32Array(buffer, result_ptr, 5)
+        const result = result_ptr>>2;
         var img = new Image();
         img.src = filename;
         this.images.push(img);
 
-        result[0] = this.images.indexOf(img);
+        this.HEAPU32[result + 0] = this.images.indexOf(img);
         // TODO: get the true width and height of the image
-        result[1] = 256; // width
-        result[2] = 256; // height
-        result[3] = 1; // mipmaps
-        result[4] = 7; // format PIXELFORMAT_UNCOMPRESSED_R8G8B8A8
-
-        return result;
+        this.HEAPU32[result + 1] = 256; // width
+        this.HEAPU32[result + 2] = 256; // height
+        this.HEAPU32[result + 3] = 1; // mipmaps
+        this.HEAPU32[result + 4] = 7; // format PIXELFORMAT_UNCOMPRESSED_R8G8B8A8
     }
 
     // RLAPI void DrawTexture(Texture2D texture, int posX, int posY, Color tint);
     DrawTexture(texture_ptr, posX, posY, color_ptr) {
-        const buffer = this.wasm.instance.exports.memory.buffer;
-        const [id, width, height, mipmaps, format] = new Uint32Array(buffer, texture_ptr, 5);
+        this.#heap();
+        const id = this.HEAPU32[texture_ptr>>2];
         // // TODO: implement tinting for DrawTexture
         // const tint = getColorFromMemory(buffer, color_ptr);
 
-        this.ctx.drawImage(this.images[id], posX, posY);
+        this.#canvas2d().ctx.drawImage(this.images[id], posX, posY);
     }
 
     // TODO: codepoints are not implemented
     LoadFontEx(result_ptr, fileName_ptr/*, fontSize, codepoints, codepointCount*/) {
-        const buffer = this.wasm.instance.exports.memory.buffer;
-        const fileName = cstr_by_ptr(buffer, fileName_ptr);
+        this.#heap();
+        const fileName = cstr_by_ptr(this.HEAPU8, fileName_ptr);
         // TODO: dynamically generate the name for the font
         // Support more than one custom font
         const font = new FontFace("myfont", `url(${fileName})`);
@@ -472,36 +1082,35 @@ class RaylibJs {
     SetTextureFilter() {}
 
     MeasureTextEx(result_ptr, font, text_ptr, fontSize, spacing) {
-        const buffer = this.wasm.instance.exports.memory.buffer;
-        const text = cstr_by_ptr(buffer, text_ptr);
-        const result = new Float32Array(buffer, result_ptr, 2);
-        this.ctx.font = fontSize+"px myfont";
+        this.#heap();
+        const text = cstr_by_ptr(this.HEAPU8, text_ptr);
+        this.state.font(fontSize, "myfont");
         const metrics = this.ctx.measureText(text)
-        result[0] = metrics.width;
-        result[1] = fontSize;
+        this.HEAPF32[result_ptr>>2] = metrics.width;
+        this.HEAPF32[(result_ptr>>2) + 1] = fontSize;
     }
     
     DrawTextEx(font, text_ptr, position_ptr, fontSize, spacing, tint_ptr) {
-        const buffer = this.wasm.instance.exports.memory.buffer;
-        const text = cstr_by_ptr(buffer, text_ptr);
-        const [posX, posY] = new Float32Array(buffer, position_ptr, 2);
-        const tint = getColorFromMemory(buffer, tint_ptr);
-        this.ctx.fillStyle = tint;
-        this.ctx.font = fontSize+"px myfont";
-        this.ctx.fillText(text, posX, posY + fontSize);
+        this.#heap();
+        const text = cstr_by_ptr(this.HEAPU8, text_ptr);
+        const posX = this.HEAPF32[position_ptr>>2], posY = this.HEAPF32[(position_ptr>>2) + 1];
+        const state = this.#canvas2d();
+        state.fillColor(this.HEAPVIEW.getUint32(tint_ptr, true));
+        state.font(fontSize, "myfont");
+        state.ctx.fillText(text, posX, posY + fontSize);
     }
     
     Vector2Distance(vector1_ptr, vector2_ptr) {
-        const buffer = this.wasm.instance.exports.memory.buffer;
-        const [v1_x, v1_y] = new Float32Array(buffer, vector1_ptr, 2);
-        const [v2_x, v2_y] = new Float32Array(buffer, vector2_ptr, 2);
+        this.#heap();
+        const v1_x = this.HEAPF32[vector1_ptr>>2], v1_y = this.HEAPF32[(vector1_ptr>>2) + 1];
+        const v2_x = this.HEAPF32[vector2_ptr>>2], v2_y = this.HEAPF32[(vector2_ptr>>2) + 1];
 
         return Math.sqrt((v1_x - v2_x)*(v1_x - v2_x) + (v1_y - v2_y)*(v1_y - v2_y));
     }
     
     ColorBrightness(result_ptr, color_ptr, factor) {
-        const buffer = this.wasm.instance.exports.memory.buffer;
-        var [r, g, b, a] = new Uint8Array(buffer, color_ptr, 4);
+        this.#heap();
+        var r = this.HEAPU8[color_ptr], g = this.HEAPU8[color_ptr + 1], b = this.HEAPU8[color_ptr + 2], a = this.HEAPU8[color_ptr + 3];
 
         if (factor > 1.0) factor = 1.0;
         else if (factor < -1.0) factor = -1.0;
@@ -517,7 +1126,91 @@ class RaylibJs {
             b = (255 - b)*factor + b;
         }
 
-        new Uint8Array(buffer, result_ptr, 4).set([r, g, b, a]);
+        this.HEAPU8[result_ptr] = r;
+        this.HEAPU8[result_ptr + 1] = g;
+        this.HEAPU8[result_ptr + 2] = b;
+        this.HEAPU8[result_ptr + 3] = a;
+    }
+
+    // Software rendered frame: one RGBA8 framebuffer in wasm memory, copied to the canvas at once
+    raylib_js_blit(pixels_ptr, width, height) {
+        if (width <= 0 || height <= 0) return;
+        this.#heap();
+        const image = this.blitImage;
+        const buffer = this.HEAPU8.buffer;
+        if (image === undefined || image.data.buffer !== buffer || image.data.byteOffset !== pixels_ptr ||
+            image.width !== width || image.height !== height) {
+            this.blitImage = new ImageData(new Uint8ClampedArray(buffer, pixels_ptr, width*height*4), width, height);
+        }
+        this.#canvas2d().ctx.putImageData(this.blitImage, 0, 0);
+    }
+
+    // Command buffer layout: one u32 word count followed by the commands, see src/balls.c
+    raylib_js_set_command_buffer(buffer_ptr, capacity) {
+        this.commandBuffer = {ptr: buffer_ptr, capacity};
+    }
+
+    raylib_js_flush_commands() {
+        this.#drawCommands();
+    }
+
+    #drawCommands() {
+        if (this.commandBuffer === undefined) return;
+        this.#heap();
+        const words = this.HEAPU32;
+        const floats = this.HEAPF32;
+        const header = this.commandBuffer.ptr>>2;
+        const end = header + 1 + words[header];
+        let i = header + 1;
+        while (i < end) {
+            switch (words[i]) {
+            case COMMAND_CLEAR:
+                this.#clear(words[i + 1]);
+                i += 2;
+                break;
+            case COMMAND_RECTANGLE:
+                this.#fillRect(floats[i + 1], floats[i + 2], floats[i + 3], floats[i + 4], words[i + 5]);
+                i += 6;
+                break;
+            case COMMAND_CIRCLE:
+                this.#fillCircle(floats[i + 1], floats[i + 2], floats[i + 3], words[i + 4]);
+                i += 5;
+                break;
+            case COMMAND_CIRCLE_GRADIENT:
+                this.#fillCircleGradient(floats[i + 1], floats[i + 2], floats[i + 3], words[i + 4], words[i + 5]);
+                i += 6;
+                break;
+            case COMMAND_TEXT:
+                this.#fillText(words[i + 1], floats[i + 2], floats[i + 3], floats[i + 4], words[i + 5]);
+                i += 6;
+                break;
+            default:
+                throw new Error(`Unknown draw command ${words[i]} at word ${i - header - 1}`);
+            }
+        }
+        words[header] = 0;
+    }
+
+    #present() {
+        if (this.hud !== undefined) this.#drawHud();
+        if (this.gl !== undefined) this.gl.present();
+        else this.circles.flush(this.state);
+    }
+
+    // In the top left corner over whatever the game drew, at the canvas resolution
+    #drawHud() {
+        const ratio = this.pixelRatio;
+        const changed = this.hud.redraw(ratio, this.frameStats());
+        const image = this.hud.canvas;
+        if (image === undefined) return;
+        const x = 8, y = 8, w = image.width/ratio, h = image.height/ratio;
+        if (this.gl !== undefined) {
+            if (changed) this.gl.releaseImage(image);
+            this.gl.image(image, x, y, w, h);
+        } else {
+            this.circles.flush(this.state);
+            this.ctx.drawImage(image, x, y, w, h);
+        }
     }
 
     raylib_js_set_entry(entry) {
@@ -525,6 +1218,825 @@ class RaylibJs {
     }
 }
 
+// Runs the game at its SetTargetFPS() rate whatever the display refresh is,
+// by skipping animation frame callbacks. Frames are due on a fixed schedule
+// rather than a fixed distance from the previous one, so on a 144 Hz display
+// a 60 FPS target alternates between two and three refreshes and averages
+// out to 60. A callback is taken when it's closer to the deadline than the
+// next one would be. The frame time is the real time since the previous
+// frame, only clamped after long pauses such as a hidden tab.
+class FramePacer {
+    static #MAX_FRAME_TIME = 0.1;   // Seconds, longer gaps are treated as a pause
+    static #WINDOW = 1000;          // Milliseconds the frame rate is averaged over
+
+    constructor() {
+        this.targetFPS = 0;         // Set by the game, 0 runs on every callback
+        this.maxFPS = 0;            // Set by the page, 0 for no cap
+        this.interval = 0;          // Measured time between callbacks (display refresh)
+        this.previousCallback = undefined;
+        this.previousFrame = undefined;
+        this.deadline = 0;
+        this.frames = 0;            // Frames run
+        this.skipped = 0;           // Callbacks skipped to keep to the target
+        this.dropped = 0;           // Frames that came later than a whole period
+        this.fps = 0;
+        this.measured = false;      // fps was updated by the last tick()
+        this.windowStart = 0;
+        this.windowFrames = 0;
+    }
+
+    rate() {
+        if (this.targetFPS <= 0) return this.maxFPS;
+        if (this.maxFPS <= 0) return this.targetFPS;
+        return Math.min(this.targetFPS, this.maxFPS);
+    }
+
+    reset(timestamp) {
+        this.previousCallback = timestamp;
+        this.previousFrame = timestamp;
+        this.deadline = timestamp;
+        this.windowStart = timestamp;
+        this.windowFrames = 0;
+    }
+
+    // Returns the frame time in seconds if a frame should run now, otherwise undefined
+    tick(timestamp) {
+        const callbackGap = timestamp - this.previousCallback;
+        this.previousCallback = timestamp;
+        if (callbackGap > 0 && callbackGap < 1000*FramePacer.#MAX_FRAME_TIME) {
+            this.interval = this.interval === 0 ? callbackGap : this.interval*0.9 + callbackGap*0.1;
+        }
+        this.measured = false;
+
+        const rate = this.rate();
+        const period = rate > 0 ? 1000/rate : 0;
+        if (period > 0) {
+            if (timestamp < this.deadline - this.interval/2) {
+                this.skipped += 1;
+                return undefined;
+            }
+            this.deadline += period;
+            // Behind by more than a period: start over instead of running frames back to back
+            if (this.deadline <= timestamp) this.deadline = timestamp + period;
+        }
+
+        const elapsed = timestamp - this.previousFrame;
+        this.previousFrame = timestamp;
+        const expected = Math.max(period, this.interval);
+        if (expected > 0 && elapsed < 1000*FramePacer.#MAX_FRAME_TIME) {
+            this.dropped += Math.max(0, Math.round(elapsed/expected) - 1);
+        }
+
+        this.frames += 1;
+        this.windowFrames += 1;
+        if (timestamp - this.windowStart >= FramePacer.#WINDOW) {
+            this.fps = this.windowFrames*1000/(timestamp - this.windowStart);
+            this.windowStart = timestamp;
+            this.windowFrames = 0;
+            this.measured = true;
+        }
+        return Math.min(elapsed/1000, FramePacer.#MAX_FRAME_TIME);
+    }
+}
+
+// Where a frame goes, for the overlay start({hud: true}) draws and for field
+// reports. The entry function is measured as "raylib:frame" with the User
+// Timing API, so it lines up in the browser's performance profiler. Import
+// calls are only summed with performance.now() per category, an entry per
+// call would cost more than most imports, and every frame ends with one
+// "raylib:draw", "raylib:input", "raylib:math" or "raylib:other" measure that
+// starts with the frame and lasts as long as the category's calls together.
+// The entries are cleared again after every frame, the profiler has them by
+// then. The last #FRAMES frames are kept for percentiles and per frame counts.
+class PerfHud {
+    static CATEGORIES = ["draw", "input", "math", "other"];
+    static #FRAMES = 240;           // About 4 seconds at 60 FPS
+    static #REFRESH = 250;          // Milliseconds between overlay redraws, the numbers would be unreadable otherwise
+    static #FONT_SIZE = 11;
+    static #LINE_HEIGHT = 14;
+    static #MARGIN = 6;
+
+    constructor() {
+        const frames = PerfHud.#FRAMES;
+        this.frameMs = new Float64Array(frames);
+        this.calls = {};            // Category -> calls per frame
+        this.ms = {};               // Category -> milliseconds per frame
+        this.current = {};          // Category -> [calls, ms] of the frame in progress
+        for (const category of PerfHud.CATEGORIES) {
+            this.calls[category] = new Uint32Array(frames);
+            this.ms[category] = new Float64Array(frames);
+            this.current[category] = [0, 0];
+        }
+        this.recorded = 0;          // Frames recorded since the start, the ring index is recorded % #FRAMES
+        this.frameStart = 0;
+        this.canvas = undefined;
+        this.redrawn = -Infinity;
+    }
+
+    // Matches raylib's naming, anything unknown counts as "other"
+    static category(name) {
+        if (/^(Begin|End|Clear|Draw|Measure|raylib_js_(blit|flush_commands))/.test(name)) return "draw";
+        if (/^(Is(Key|Mouse|Gesture)|Get(Mouse|Key|Char|Touch|Gamepad)|raylib_js_set_input)/.test(name)) return "input";
+        if (/^(CheckCollision|Vector|Matrix|Quaternion|Color|Fade|GetRandomValue|Clamp|Lerp|Remap|rand$)/.test(name)) return "math";
+        return "other";
+    }
+
+    // Replaces the functions of a make_environment() import object with timed ones
+    instrument(imports) {
+        for (const namespace of Object.values(imports)) {
+            for (const [name, fn] of Object.entries(namespace)) {
+                if (typeof fn !== "function") continue;
+                const totals = this.current[PerfHud.category(name)];
+                // arguments rather than a rest parameter, so a call doesn't allocate
+                namespace[name] = function () {
+                    const start = performance.now();
+                    const result = fn.apply(undefined, arguments);
+                    totals[0] += 1;
+                    totals[1] += performance.now() - start;
+                    return result;
+                };
+            }
+        }
+    }
+
+    beginFrame() {
+        for (const category of PerfHud.CATEGORIES) this.current[category].fill(0);
+        performance.mark("raylib:frame");
+        this.frameStart = performance.now();
+    }
+
+    endFrame() {
+        const end = performance.now();
+        const detail = {};
+        for (const category of PerfHud.CATEGORIES) {
+            const [calls, ms] = this.current[category];
+            detail[category] = calls;
+            if (calls > 0) performance.measure(`raylib:${category}`, {start: this.frameStart, duration: ms, detail: {calls}});
+        }
+        performance.measure("raylib:frame", {start: "raylib:frame", end, detail});
+        performance.clearMarks("raylib:frame");
+        performance.clearMeasures("raylib:frame");
+        for (const category of PerfHud.CATEGORIES) performance.clearMeasures(`raylib:${category}`);
+
+        const i = this.recorded % PerfHud.#FRAMES;
+        this.frameMs[i] = end - this.frameStart;
+        for (const category of PerfHud.CATEGORIES) {
+            this.calls[category][i] = this.current[category][0];
+            this.ms[category][i] = this.current[category][1];
+        }
+        this.recorded += 1;
+    }
+
+    // Rolling numbers over the kept frames, plain data for JSON.stringify()
+    report() {
+        const n = Math.min(this.recorded, PerfHud.#FRAMES);
+        // Oldest first
+        const first = this.recorded - n;
+        const frames = Array.from({length: n}, (_, k) => this.frameMs[(first + k) % PerfHud.#FRAMES]);
+        const sorted = frames.slice().sort((a, b) => a - b);
+        const percentile = (p) => n > 0 ? sorted[Math.min(n - 1, Math.floor(p*n))] : 0;
+        const sum = (values) => {
+            let total = 0;
+            for (let k = 0; k < n; ++k) total += values[(first + k) % PerfHud.#FRAMES];
+            return total;
+        };
+        const imports = {};
+        for (const category of PerfHud.CATEGORIES) {
+            imports[category] = {
+                callsPerFrame: n > 0 ? sum(this.calls[category])/n : 0,
+                msPerFrame: n > 0 ? sum(this.ms[category])/n : 0,
+            };
+        }
+        const memory = typeof performance !== "undefined" ? performance.memory : undefined;
+        return {
+            frames: n,
+            frameMs: {
+                p50: percentile(0.5),
+                p99: percentile(0.99),
+                mean: n > 0 ? frames.reduce((a, b) => a + b, 0)/n : 0,
+                max: n > 0 ? sorted[n - 1] : 0,
+            },
+            imports,
+            // Chromium only
+            jsHeapBytes: memory !== undefined ? memory.usedJSHeapSize : undefined,
+            frameTimesMs: frames,
+        };
+    }
+
+    // Renders the overlay at most every #REFRESH milliseconds into its own canvas,
+    // returns whether it changed. stats are RaylibJs.frameStats().
+    redraw(pixelRatio, stats) {
+        if (typeof OffscreenCanvas === "undefined") return false;
+        const now = performance.now();
+        if (this.canvas !== undefined && now - this.redrawn < PerfHud.#REFRESH) return false;
+        this.redrawn = now;
+
+        const report = this.report();
+        const mb = (bytes) => bytes !== undefined ? `${(bytes/(1024*1024)).toFixed(1)} MB` : "n/a";
+        const imports = PerfHud.CATEGORIES.map((category) => `${category} ${report.imports[category].callsPerFrame.toFixed(0)}`);
+        const lines = [
+            `${stats.fps.toFixed(1)} FPS` + (stats.targetFPS > 0 ? ` / ${stats.targetFPS}` : ""),
+            `frame p50 ${report.frameMs.p50.toFixed(2)} ms  p99 ${report.frameMs.p99.toFixed(2)} ms`,
+            `imports/frame ${imports.join("  ")}`,
+            `JS heap ${mb(report.jsHeapBytes)}  wasm ${mb(stats.memoryBytes)}`,
+        ];
+
+        const font = `${PerfHud.#FONT_SIZE*pixelRatio}px monospace`;
+        if (this.canvas === undefined) this.canvas = new OffscreenCanvas(1, 1);
+        let ctx = this.canvas.getContext("2d");
+        ctx.font = font;
+        const textWidth = Math.max(...lines.map((line) => ctx.measureText(line).width));
+        const margin = PerfHud.#MARGIN*pixelRatio;
+        const width = Math.ceil(textWidth + 2*margin);
+        const height = Math.ceil((lines.length*PerfHud.#LINE_HEIGHT + PerfHud.#MARGIN)*pixelRatio);
+        if (this.canvas.width !== width || this.canvas.height !== height) {
+            // Resizing resets the context state
+            this.canvas.width = width;
+            this.canvas.height = height;
+            ctx = this.canvas.getContext("2d");
+            ctx.font = font;
+        }
+        ctx.clearRect(0, 0, width, height);
+        ctx.fillStyle = "rgba(0, 0, 0, 0.75)";
+        ctx.fillRect(0, 0, width, height);
+        ctx.fillStyle = "#e7e7e7";
+        ctx.textBaseline = "top";
+        lines.forEach((line, k) => ctx.fillText(line, margin, margin + k*PerfHud.#LINE_HEIGHT*pixelRatio));
+        return true;
+    }
+}
+
+// Remembers what was last assigned to a 2D context, so per draw style changes
+// that wouldn't change anything are skipped. Colors are compared as packed
+// RGBA u32 and only turned into strings, through color_string(), on change.
+// Call invalidate() whenever the context state was reset, e.g. after resizing.
+// The logical to canvas pixel scale is part of that state and reapplied.
+class CanvasState {
+    constructor(ctx) {
+        this.ctx = ctx;
+        this.scale = 1;
+        this.invalidate();
+    }
+
+    invalidate() {
+        this.fill = undefined;
+        this.stroke = undefined;
+        this.width = undefined;
+        this.fontSize = undefined;
+        this.fontFamily = undefined;
+        this.ctx.setTransform(this.scale, 0, 0, this.scale, 0, 0);
+    }
+
+    setScale(scale) {
+        this.scale = scale;
+        this.invalidate();
+    }
+
+    fillColor(color) {
+        if (this.fill === color) return;
+        this.ctx.fillStyle = color_string(color);
+        this.fill = color;
+    }
+
+    fillGradient(gradient) {
+        this.ctx.fillStyle = gradient;
+        this.fill = undefined;
+    }
+
+    strokeColor(color) {
+        if (this.stroke === color) return;
+        this.ctx.strokeStyle = color_string(color);
+        this.stroke = color;
+    }
+
+    lineWidth(width) {
+        if (this.width === width) return;
+        this.ctx.lineWidth = width;
+        this.width = width;
+    }
+
+    font(size, family) {
+        if (this.fontSize === size && this.fontFamily === family) return;
+        this.ctx.font = `${size}px ${family}`;
+        this.fontSize = size;
+        this.fontFamily = family;
+    }
+}
+
+// Canvas2D circles are collected until something else is drawn, then every
+// run of consecutive circles with the same color is filled as one path
+// instead of a beginPath/arc/fill per circle. A path is filled once, so
+// translucent circles in it would blend once where they overlap instead of
+// twice: a circle that overlaps one of its run, or comes within a pixel of
+// its antialiased edge, starts a new run. With runs filled in submission
+// order the frame looks as if every circle was filled on its own. Alpha is
+// quantized in steps that grow with it, about 3% of the value, so fading
+// particles with nearly the same alpha share a run and faint ones still show.
+class CircleBatch {
+    constructor() {
+        this.circles = [];          // Flat x, y, radius list, kept between frames
+        this.runs = [];             // Flat color, end index into circles list
+        this.count = 0;
+    }
+
+    add(x, y, radius, color) {
+        const a = color >>> 24;
+        if (a === 0) return;
+        const step = 1 << Math.max(0, 27 - Math.clz32(a));     // 1 below 32, then 2, 4, 8
+        const alpha = Math.min(255, Math.round(a/step)*step);
+        const key = ((color & 0x00FFFFFF) | (alpha << 24)) >>> 0;
+        const circles = this.circles;
+        const runs = this.runs;
+        let merge = runs.length > 0 && runs[runs.length - 2] === key;
+        for (let i = runs.length > 2 ? runs[runs.length - 3] : 0; merge && i < circles.length; i += 3) {
+            const dx = circles[i] - x;
+            const dy = circles[i + 1] - y;
+            const r = circles[i + 2] + radius + 1;
+            merge = dx*dx + dy*dy > r*r;
+        }
+        circles.push(x, y, radius);
+        if (merge) {
+            runs[runs.length - 1] = circles.length;
+        } else {
+            runs.push(key, circles.length);
+        }
+        this.count += 1;
+    }
+
+    flush(state) {
+        if (this.count === 0) return;
+        const ctx = state.ctx;
+        const circles = this.circles;
+        let i = 0;
+        for (let r = 0; r < this.runs.length; r += 2) {
+            const end = this.runs[r + 1];
+            ctx.beginPath();
+            for (; i < end; i += 3) {
+                ctx.moveTo(circles[i] + circles[i + 2], circles[i + 1]);
+                ctx.arc(circles[i], circles[i + 1], circles[i + 2], 0, 2*Math.PI, false);
+            }
+            state.fillColor(this.runs[r]);
+            ctx.fill();
+        }
+        this.discard();
+    }
+
+    discard() {
+        this.circles.length = 0;
+        this.runs.length = 0;
+        this.count = 0;
+    }
+}
+
+// Gradient balls pre-rendered once per inner color, outer color and whole
+// radius, so Canvas2D draws them with a single drawImage instead of building
+// a radial gradient and filling a path for every ball every frame.
+class GradientSprites {
+    static #MAX_RADIUS = 256;   // Bigger balls are rare and drawn directly
+    static #MAX_SPRITES = 1024;
+
+    constructor() {
+        this.sprites = new Map();   // inner color -> (outer color*1024 + radius) -> sprite
+        this.count = 0;
+    }
+
+    get(radius, inner, outer) {
+        const bucket = Math.ceil(radius);
+        if (bucket <= 0 || bucket > GradientSprites.#MAX_RADIUS || typeof OffscreenCanvas === "undefined") return undefined;
+        let byOuter = this.sprites.get(inner);
+        if (byOuter === undefined) {
+            byOuter = new Map();
+            this.sprites.set(inner, byOuter);
+        }
+        const key = outer*1024 + bucket;
+        let sprite = byOuter.get(key);
+        if (sprite === undefined) {
+            if (this.count >= GradientSprites.#MAX_SPRITES) {
+                this.clear();
+                this.sprites.set(inner, byOuter);
+            }
+            sprite = GradientSprites.#render(bucket, inner, outer);
+            byOuter.set(key, sprite);
+            this.count += 1;
+        }
+        return sprite;
+    }
+
+    clear() {
+        for (const byOuter of this.sprites.values()) {
+            for (const sprite of byOuter.values()) {
+                if (sprite.close !== undefined) sprite.close();
+            }
+            byOuter.clear();
+        }
+        this.sprites.clear();
+        this.count = 0;
+    }
+
+    // One pixel of padding around the disc keeps its antialiased edge
+    static #render(radius, inner, outer) {
+        const size = 2*radius + 2;
+        const canvas = new OffscreenCanvas(size, size);
+        const ctx = canvas.getContext("2d");
+        const center = size/2;
+        ctx.beginPath();
+        ctx.arc(center, center, radius, 0, Math.PI*2, false);
+        ctx.fillStyle = radial_gradient(ctx, center, center, radius, inner, outer);
+        ctx.fill();
+        return typeof canvas.transferToImageBitmap === "function" ? canvas.transferToImageBitmap() : canvas;
+    }
+}
+
+// DrawText() output rendered once per string, font size and color into an
+// image, so static labels cost a single blit per frame. C strings are
+// interned by pointer: the bytes are kept and compared on every lookup, which
+// is cheaper than decoding, and a buffer that is rewritten (a score, an FPS
+// counter) just replaces its entry and drops the images made for the old text.
+// Nothing is cached until the font has loaded, the fallback would stick.
+class TextLabels {
+    static PADDING = 2;             // Room for glyphs that overhang their advance
+    static #MAX_LABELS = 256;
+
+    constructor(onEvict) {
+        this.strings = new Map();   // pointer -> { bytes, text, labels: (pixel size*2^32 + color) -> image }
+        this.count = 0;
+        this.onEvict = onEvict;
+    }
+
+    intern(mem, ptr) {
+        let entry = this.strings.get(ptr);
+        if (entry !== undefined && TextLabels.#matches(entry.bytes, mem, ptr)) return entry;
+        if (entry !== undefined) this.#drop(entry);
+        const bytes = mem.slice(ptr, ptr + cstrlen(mem, ptr));
+        entry = { ptr, bytes, text: textDecoder.decode(bytes), labels: new Map() };
+        this.strings.set(ptr, entry);
+        return entry;
+    }
+
+    label(entry, pixelSize, family, color) {
+        const key = pixelSize*4294967296 + color;
+        let image = entry.labels.get(key);
+        if (image !== undefined) return image;
+
+        if (typeof OffscreenCanvas === "undefined") return undefined;
+        const fonts = globalThis.document !== undefined ? globalThis.document.fonts : globalThis.fonts;
+        const font = `${pixelSize}px ${family}`;
+        if (fonts !== undefined && !fonts.check(font)) return undefined;
+
+        if (this.count >= TextLabels.#MAX_LABELS) {
+            this.clear();
+            this.strings.set(entry.ptr, entry);
+        }
+        image = TextLabels.#render(entry.text, font, pixelSize, color);
+        entry.labels.set(key, image);
+        this.count += 1;
+        return image;
+    }
+
+    clear() {
+        for (const entry of this.strings.values()) this.#drop(entry);
+        this.strings.clear();
+    }
+
+    #drop(entry) {
+        for (const image of entry.labels.values()) {
+            this.onEvict(image);
+            if (image.close !== undefined) image.close();
+        }
+        this.count -= entry.labels.size;
+        entry.labels.clear();
+    }
+
+    static #matches(bytes, mem, ptr) {
+        if (mem[ptr + bytes.length] !== 0) return false;
+        for (let i = 0; i < bytes.length; ++i) {
+            if (mem[ptr + i] !== bytes[i]) return false;
+        }
+        return true;
+    }
+
+    // Same layout as the uncached path: one line per fontSize, baseline at the bottom of the line
+    static #render(text, font, size, color) {
+        const lines = text.split('\n');
+        const measure = new OffscreenCanvas(1, 1).getContext("2d");
+        measure.font = font;
+        let width = 1, descent = 0;
+        for (const line of lines) {
+            const metrics = measure.measureText(line);
+            width = Math.max(width, metrics.width, metrics.actualBoundingBoxRight);
+            descent = Math.max(descent, metrics.actualBoundingBoxDescent);
+        }
+
+        const pad = TextLabels.PADDING;
+        const canvas = new OffscreenCanvas(Math.ceil(width) + 2*pad, Math.ceil(lines.length*size + descent) + 2*pad);
+        const ctx = canvas.getContext("2d");
+        ctx.font = font;
+        ctx.fillStyle = color_string(color);
+        for (let i = 0; i < lines.length; ++i) {
+            ctx.fillText(lines[i], pad, pad + size + i*size);
+        }
+        return typeof canvas.transferToImageBitmap === "function" ? canvas.transferToImageBitmap() : canvas;
+    }
+}
+
+// WebGL2 backend: circles and rectangles are accumulated into one instance
+// buffer and drawn as instanced quads, the circle coverage and gradient come
+// from a signed distance in the fragment shader. Anything the batch can't
+// express (text, strokes, images) is drawn into a 2D overlay canvas that is
+// composited in draw order whenever the batch is flushed after it.
+class WebGL2Renderer {
+    // Per instance: center x, y, half width, half height, radius (0 for rectangles), inner and outer RGBA8
+    static #INSTANCE_FLOATS = 7;
+
+    static #INSTANCE_VS = `#version 300 es
+layout(location = 0) in vec2 corner;
+layout(location = 1) in vec4 rect;
+layout(location = 2) in float radius;
+layout(location = 3) in vec4 inner;
+layout(location = 4) in vec4 outer;
+uniform vec2 screen;
+out vec2 local;
+out float v_radius;
+out vec4 v_inner;
+out vec4 v_outer;
+void main() {
+    local = corner*rect.zw;
+    v_radius = radius;
+    v_inner = inner;
+    v_outer = outer;
+    vec2 p = rect.xy + local;
+    gl_Position = vec4(p.x/screen.x*2.0 - 1.0, 1.0 - p.y/screen.y*2.0, 0.0, 1.0);
+}`;
+
+    static #INSTANCE_FS = `#version 300 es
+precision highp float;
+in vec2 local;
+in float v_radius;
+in vec4 v_inner;
+in vec4 v_outer;
+uniform float scale;
+out vec4 color;
+void main() {
+    vec4 c = v_inner;
+    if (v_radius > 0.0) {
+        float d = length(local);
+        // Same stops as radial_gradient(): inner up to r/2, outer from 3r/4 on
+        c = mix(v_inner, v_outer, clamp(4.0*d/v_radius - 2.0, 0.0, 1.0));
+        // Antialiased over one canvas pixel
+        c.a *= clamp((v_radius - d)*scale + 0.5, 0.0, 1.0);
+    }
+    color = vec4(c.rgb*c.a, c.a);
+}`;
+
+    // Also draws cached images (pre-rendered text) anywhere on the screen
+    static #OVERLAY_VS = `#version 300 es
+layout(location = 0) in vec2 corner;
+uniform vec4 dest;
+uniform vec2 screen;
+out vec2 uv;
+void main() {
+    uv = vec2(corner.x*0.5 + 0.5, 0.5 - corner.y*0.5);
+    vec2 p = dest.xy + uv*dest.zw;
+    gl_Position = vec4(p.x/screen.x*2.0 - 1.0, 1.0 - p.y/screen.y*2.0, 0.0, 1.0);
+}`;
+
+    static #OVERLAY_FS = `#version 300 es
+precision highp float;
+in vec2 uv;
+uniform sampler2D overlay;
+out vec4 color;
+void main() {
+    color = texture(overlay, uv);
+}`;
+
+    constructor(gl) {
+        this.gl = gl;
+        this.overlay = new OffscreenCanvas(gl.canvas.width || 1, gl.canvas.height || 1).getContext("2d");
+        this.overlayDirty = false;
+        this.capacity = 1024;
+        this.data = new ArrayBuffer(this.capacity*WebGL2Renderer.#INSTANCE_FLOATS*4);
+        this.floats = new Float32Array(this.data);
+        this.colors = new Uint32Array(this.data);
+        this.count = 0;
+
+        this.instanceProgram = this.#program(WebGL2Renderer.#INSTANCE_VS, WebGL2Renderer.#INSTANCE_FS);
+        this.screenLocation = gl.getUniformLocation(this.instanceProgram, "screen");
+        this.scaleLocation = gl.getUniformLocation(this.instanceProgram, "scale");
+        this.scale = 1;     // Canvas pixels per logical pixel, everything is drawn in logical pixels
+        this.overlayProgram = this.#program(WebGL2Renderer.#OVERLAY_VS, WebGL2Renderer.#OVERLAY_FS);
+        this.destLocation = gl.getUniformLocation(this.overlayProgram, "dest");
+        this.overlayScreenLocation = gl.getUniformLocation(this.overlayProgram, "screen");
+        this.textures = new Map();  // Cached image -> texture
+
+        this.corners = gl.createBuffer();
+        gl.bindBuffer(gl.ARRAY_BUFFER, this.corners);
+        gl.bufferData(gl.ARRAY_BUFFER, new Float32Array([-1, -1, 1, -1, -1, 1, 1, 1]), gl.STATIC_DRAW);
+        this.instances = gl.createBuffer();
+
+        const stride = WebGL2Renderer.#INSTANCE_FLOATS*4;
+        this.instanceVao = gl.createVertexArray();
+        gl.bindVertexArray(this.instanceVao);
+        gl.bindBuffer(gl.ARRAY_BUFFER, this.corners);
+        gl.enableVertexAttribArray(0);
+        gl.vertexAttribPointer(0, 2, gl.FLOAT, false, 0, 0);
+        gl.bindBuffer(gl.ARRAY_BUFFER, this.instances);
+        gl.enableVertexAttribArray(1);
+        gl.vertexAttribPointer(1, 4, gl.FLOAT, false, stride, 0);
+        gl.vertexAttribDivisor(1, 1);
+        gl.enableVertexAttribArray(2);
+        gl.vertexAttribPointer(2, 1, gl.FLOAT, false, stride, 16);
+        gl.vertexAttribDivisor(2, 1);
+        gl.enableVertexAttribArray(3);
+        gl.vertexAttribPointer(3, 4, gl.UNSIGNED_BYTE, true, stride, 20);
+        gl.vertexAttribDivisor(3, 1);
+        gl.enableVertexAttribArray(4);
+        gl.vertexAttribPointer(4, 4, gl.UNSIGNED_BYTE, true, stride, 24);
+        gl.vertexAttribDivisor(4, 1);
+
+        this.overlayVao = gl.createVertexArray();
+        gl.bindVertexArray(this.overlayVao);
+        gl.bindBuffer(gl.ARRAY_BUFFER, this.corners);
+        gl.enableVertexAttribArray(0);
+        gl.vertexAttribPointer(0, 2, gl.FLOAT, false, 0, 0);
+        gl.bindVertexArray(null);
+
+        this.overlayTexture = gl.createTexture();
+        gl.bindTexture(gl.TEXTURE_2D, this.overlayTexture);
+        gl.texParameteri(gl.TEXTURE_2D, gl.TEXTURE_MIN_FILTER, gl.NEAREST);
+        gl.texParameteri(gl.TEXTURE_2D, gl.TEXTURE_MAG_FILTER, gl.NEAREST);
+        gl.texParameteri(gl.TEXTURE_2D, gl.TEXTURE_WRAP_S, gl.CLAMP_TO_EDGE);
+        gl.texParameteri(gl.TEXTURE_2D, gl.TEXTURE_WRAP_T, gl.CLAMP_TO_EDGE);
+        gl.pixelStorei(gl.UNPACK_PREMULTIPLY_ALPHA_WEBGL, true);
+
+        gl.enable(gl.BLEND);
+        gl.blendFunc(gl.ONE, gl.ONE_MINUS_SRC_ALPHA);
+    }
+
+    #program(vsSource, fsSource) {
+        const gl = this.gl;
+        const compile = (type, source) => {
+            const shader = gl.createShader(type);
+            gl.shaderSource(shader, source);
+            gl.compileShader(shader);
+            if (!gl.getShaderParameter(shader, gl.COMPILE_STATUS)) {
+                throw new Error(`Could not compile shader: ${gl.getShaderInfoLog(shader)}`);
+            }
+            return shader;
+        };
+        const program = gl.createProgram();
+        gl.attachShader(program, compile(gl.VERTEX_SHADER, vsSource));
+        gl.attachShader(program, compile(gl.FRAGMENT_SHADER, fsSource));
+        gl.linkProgram(program);
+        if (!gl.getProgramParameter(program, gl.LINK_STATUS)) {
+            throw new Error(`Could not link program: ${gl.getProgramInfoLog(program)}`);
+        }
+        return program;
+    }
+
+    #push(x, y, hw, hh, radius, inner, outer) {
+        if (this.overlayDirty) this.#flush();
+        if (this.count === this.capacity) {
+            this.capacity *= 2;
+            const data = new ArrayBuffer(this.capacity*WebGL2Renderer.#INSTANCE_FLOATS*4);
+            new Uint8Array(data).set(new Uint8Array(this.data));
+            this.data = data;
+            this.floats = new Float32Array(data);
+            this.colors = new Uint32Array(data);
+        }
+        const i = this.count*WebGL2Renderer.#INSTANCE_FLOATS;
+        this.floats[i + 0] = x;
+        this.floats[i + 1] = y;
+        this.floats[i + 2] = hw;
+        this.floats[i + 3] = hh;
+        this.floats[i + 4] = radius;
+        this.colors[i + 5] = inner;
+        this.colors[i + 6] = outer;
+        this.count += 1;
+    }
+
+    // Draw the pending instances, then the overlay on top of them if anything was drawn into it
+    #flush() {
+        const gl = this.gl;
+        gl.viewport(0, 0, gl.canvas.width, gl.canvas.height);
+        if (this.count > 0) {
+            gl.useProgram(this.instanceProgram);
+            gl.uniform2f(this.screenLocation, gl.canvas.width/this.scale, gl.canvas.height/this.scale);
+            gl.uniform1f(this.scaleLocation, this.scale);
+            gl.bindBuffer(gl.ARRAY_BUFFER, this.instances);
+            gl.bufferData(gl.ARRAY_BUFFER, this.floats, gl.STREAM_DRAW, 0, this.count*WebGL2Renderer.#INSTANCE_FLOATS);
+            gl.bindVertexArray(this.instanceVao);
+            gl.drawArraysInstanced(gl.TRIANGLE_STRIP, 0, 4, this.count);
+            this.count = 0;
+        }
+        if (this.overlayDirty) {
+            const overlay = this.overlay;
+            gl.bindTexture(gl.TEXTURE_2D, this.overlayTexture);
+            gl.texImage2D(gl.TEXTURE_2D, 0, gl.RGBA, gl.RGBA, gl.UNSIGNED_BYTE, overlay.canvas);
+            this.#drawTexture(0, 0, gl.canvas.width/this.scale, gl.canvas.height/this.scale);
+            overlay.clearRect(0, 0, overlay.canvas.width, overlay.canvas.height);
+            this.overlayDirty = false;
+        }
+        gl.bindVertexArray(null);
+    }
+
+    // Draw the bound texture over the given logical rectangle
+    #drawTexture(x, y, w, h) {
+        const gl = this.gl;
+        gl.useProgram(this.overlayProgram);
+        gl.uniform4f(this.destLocation, x, y, w, h);
+        gl.uniform2f(this.overlayScreenLocation, gl.canvas.width/this.scale, gl.canvas.height/this.scale);
+        gl.bindVertexArray(this.overlayVao);
+        gl.drawArrays(gl.TRIANGLE_STRIP, 0, 4);
+    }
+
+    // Draw an image that doesn't change, e.g. cached text, from its own texture
+    // so it doesn't force an upload of the whole overlay
+    image(image, x, y, w, h) {
+        const gl = this.gl;
+        this.#flush();
+        let texture = this.textures.get(image);
+        if (texture === undefined) {
+            texture = gl.createTexture();
+            gl.bindTexture(gl.TEXTURE_2D, texture);
+            gl.texParameteri(gl.TEXTURE_2D, gl.TEXTURE_MIN_FILTER, gl.NEAREST);
+            gl.texParameteri(gl.TEXTURE_2D, gl.TEXTURE_MAG_FILTER, gl.NEAREST);
+            gl.texParameteri(gl.TEXTURE_2D, gl.TEXTURE_WRAP_S, gl.CLAMP_TO_EDGE);
+            gl.texParameteri(gl.TEXTURE_2D, gl.TEXTURE_WRAP_T, gl.CLAMP_TO_EDGE);
+            gl.texImage2D(gl.TEXTURE_2D, 0, gl.RGBA, gl.RGBA, gl.UNSIGNED_BYTE, image);
+            this.textures.set(image, texture);
+        } else {
+            gl.bindTexture(gl.TEXTURE_2D, texture);
+        }
+        this.#drawTexture(x, y, w, h);
+        gl.bindVertexArray(null);
+    }
+
+    releaseImage(image) {
+        const texture = this.textures.get(image);
+        if (texture === undefined) return;
+        this.gl.deleteTexture(texture);
+        this.textures.delete(image);
+    }
+
+    setScale(scale) {
+        this.scale = scale;
+    }
+
+    // Mark the overlay as drawn into and keep it sized like the canvas, returns whether it was resized
+    beginOverlay() {
+        const overlay = this.overlay;
+        const canvas = this.gl.canvas;
+        this.overlayDirty = true;
+        if (overlay.canvas.width !== canvas.width || overlay.canvas.height !== canvas.height) {
+            overlay.canvas.width = canvas.width;
+            overlay.canvas.height = canvas.height;
+            return true;
+        }
+        return false;
+    }
+
+    clear(color) {
+        // Everything pending would be covered anyway
+        this.count = 0;
+        if (this.overlayDirty) {
+            this.overlay.clearRect(0, 0, this.overlay.canvas.width, this.overlay.canvas.height);
+            this.overlayDirty = false;
+        }
+        const gl = this.gl;
+        gl.clearColor((color&0xFF)/255, ((color>>8)&0xFF)/255, ((color>>16)&0xFF)/255, ((color>>>24)&0xFF)/255);
+        gl.clear(gl.COLOR_BUFFER_BIT);
+    }
+
+    rect(x, y, w, h, color) {
+        this.#push(x + w/2, y + h/2, w/2, h/2, 0, color, color);
+    }
+
+    circle(x, y, radius, inner, outer) {
+        // Margin for the antialiased edge, a canvas pixel at least
+        const margin = Math.max(1, 1/this.scale);
+        this.#push(x, y, radius + margin, radius + margin, radius, inner, outer);
+    }
+
+    present() {
+        this.#flush();
+    }
+
+    dispose() {
+        const gl = this.gl;
+        gl.clearColor(0, 0, 0, 0);
+        gl.clear(gl.COLOR_BUFFER_BIT);
+        gl.deleteBuffer(this.corners);
+        gl.deleteBuffer(this.instances);
+        gl.deleteVertexArray(this.instanceVao);
+        gl.deleteVertexArray(this.overlayVao);
+        gl.deleteTexture(this.overlayTexture);
+        for (const texture of this.textures.values()) gl.deleteTexture(texture);
+        this.textures.clear();
+        gl.deleteProgram(this.instanceProgram);
+        gl.deleteProgram(this.overlayProgram);
+    }
+}
+
 const glfwMouseButtonMapping = {
     0: 0, // MOUSE_BUTTON_LEFT
     2: 1, // MOUSE_BUTTON_RIGHT
@@ -664,11 +2176,13 @@ function cstrlen(mem, ptr) {
     return len;
 }
 
-function cstr_by_ptr(mem_buffer, ptr) {
-    const mem = new Uint8Array(mem_buffer);
+const textDecoder = new TextDecoder();
+
+// TextDecoder doesn't take views of shared memory, those are copied
+function cstr_by_ptr(mem, ptr) {
     const len = cstrlen(mem, ptr);
-    const bytes = new Uint8Array(mem_buffer, ptr, len);
-    return new TextDecoder().decode(bytes);
+    const bytes = mem.buffer instanceof ArrayBuffer ? mem.subarray(ptr, ptr + len) : mem.slice(ptr, ptr + len);
+    return textDecoder.decode(bytes);
 }
 
 function color_hex_unpacked(r, g, b, a) {
@@ -687,7 +2201,33 @@ function color_hex(color) {
     return "#"+r+g+b+a;
 }
 
+function radial_gradient(ctx, x, y, radius, color, color2) {
+    const gradient = ctx.createRadialGradient(x, y, radius/2, x, y, radius);
+    gradient.addColorStop(0, color_string(color));
+    gradient.addColorStop(0.5, color_string(color2));
+    return gradient;
+}
+
+// CSS strings for packed colors. A frame only uses a handful of distinct
+// colors, the cap just keeps a pathological program from growing it forever.
+const COLOR_STRINGS_MAX = 4096;
+const colorStrings = new Map();
+
+function color_string(color) {
+    let string = colorStrings.get(color);
+    if (string === undefined) {
+        if (colorStrings.size >= COLOR_STRINGS_MAX) colorStrings.clear();
+        string = color_hex(color);
+        colorStrings.set(color, string);
+    }
+    return string;
+}
+
 function getColorFromMemory(buffer, color_ptr) {
     const [r, g, b, a] = new Uint8Array(buffer, color_ptr, 4);
     return color_hex_unpacked(r, g, b, a);
 }
+
+if (typeof WorkerGlobalScope !== "undefined" && self instanceof WorkerGlobalScope) {
+    RaylibJs.serveWorker();
+}
@@ -1,18 +1,54 @@
 #include "raylib.h"
+#ifdef PLATFORM_WEB
+// There is no libraylib in the web build, so raymath must never become imports
+#define RAYMATH_STATIC_INLINE
+#endif
 #include "raymath.h"
 
 #ifndef PLATFORM_WEB
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <math.h>
 #include <time.h>
 
+#include "rlgl.h"
+
+// Natively the software rasterizer is always there to back --headless
+#define SOFTWARE_RENDER
+
 #else
 
 #define RAND_MAX 2147483647 
 int rand(void);
 
+#ifdef __wasm_simd128__
+// The SIMD build (balls_simd.wasm) does the collision search and particle movement 4 and 2 lanes at a time
+#include <wasm_simd128.h>
+#endif
+
+#endif // PLATFORM_WEB
+
+#if defined(PLATFORM_WEB) && !defined(SOFTWARE_RENDER)
+// Draw calls are recorded into linear memory and replayed by raylib.js at EndDrawing
+#define COMMAND_BUFFER
+#endif
+
+#define HEAP_IMPLEMENTATION
+#include "heap.h"
+
+#define JOBS_IMPLEMENTATION
+#include "jobs.h"
+
+#ifdef SOFTWARE_RENDER
+#define SWRAST_IMPLEMENTATION
+#include "swrast.h"
+#endif // SOFTWARE_RENDER
+
+#ifndef PLATFORM_WEB
+#define CAPTURE_IMPLEMENTATION
+#include "capture.h"
 #endif // PLATFORM_WEB
 
 // Colors
@@ -44,7 +80,366 @@ static int height = HEIGHT;
 // Settings
 // --------------------------------------
 static bool pop_on_collision = true;
+static bool trails = false;     // T: keep the last frame and fade it instead of clearing
+// --------------------------------------
+
+#ifndef PLATFORM_WEB
+// Command line options
 // --------------------------------------
+static bool msaa = false;       // --msaa: draw geometric circles and let 4x MSAA smooth the edges
+static int window_width = 0;    // --size WxH, 0 means the monitor size
+static int window_height = 0;
+static int bench_frames = 0;    // --bench N: run N frames uncapped and report the average frame time
+static bool headless = false;   // --headless: no window, render with the software rasterizer
+static int threads = 0;         // --threads N: worker threads for rasterizing and vertex generation, 0 means one per CPU
+static unsigned int seed = 0;   // --seed S: fixed seed for reproducible runs, 0 means time based
+static const char *dump_path = NULL; // --dump FILE: write the last frame as a binary PPM
+static const char *capture_path = NULL; // --capture PATH: record every frame to a .y4m file or a PNG sequence
+// --------------------------------------
+#endif // PLATFORM_WEB
+
+#ifdef SOFTWARE_RENDER
+#ifdef PLATFORM_WEB
+static bool software = true;
+#else
+static bool software = false;
+#endif
+#endif // SOFTWARE_RENDER
+
+
+// Platform
+// ------------------------------------------------------------
+// Frame and input queries go through here so --headless can run the
+// simulation without raylib ever opening a window. Headless runs use a fixed
+// time step and a mouse that never moves.
+#ifdef PLATFORM_WEB
+#ifdef SOFTWARE_RENDER
+void raylib_js_blit(const unsigned char *pixels, int width, int height);
+#endif
+
+// raylib.js fills this in once per frame before game_frame() runs, so input
+// queries are plain memory reads instead of calls into JS. Keep the layout in
+// sync with #writeInput() in js/raylib.js.
+#define INPUT_KEY_WORDS 16      // One bit per key code below 512
+
+typedef struct {
+    Vector2 mouse;
+    Vector2 mouse_delta;        // Movement since the previous frame
+    float wheel;
+    int screen_width;
+    int screen_height;
+    unsigned int buttons_down;  // One bit per mouse button
+    unsigned int buttons_pressed;
+    unsigned int keys_down[INPUT_KEY_WORDS];
+    unsigned int keys_pressed[INPUT_KEY_WORDS];
+} InputSnapshot;
+
+static InputSnapshot input = {0};
+
+void raylib_js_set_input(InputSnapshot *snapshot);
+#else
+static const float headless_dt = 1.0f/60.0f;
+#endif // PLATFORM_WEB
+
+
+void begin_frame(void)
+{
+#ifndef PLATFORM_WEB
+    if (headless) {
+        width = window_width;
+        height = window_height;
+    } else
+#endif
+    {
+        BeginDrawing();
+#ifdef PLATFORM_WEB
+        width = input.screen_width;
+        height = input.screen_height;
+#else
+        width = GetScreenWidth();
+        height = GetScreenHeight();
+#endif
+    }
+#ifdef SOFTWARE_RENDER
+    if (software) swr_begin(width, height);
+#endif
+}
+
+
+void end_frame(void)
+{
+#ifdef SOFTWARE_RENDER
+    if (software) {
+        swr_end();
+#ifdef PLATFORM_WEB
+        raylib_js_blit(swr_pixels(), swr_width(), swr_height());
+#else
+        capture_pixels(swr_pixels(), swr_width(), swr_height());
+#endif
+    }
+#endif
+#ifndef PLATFORM_WEB
+    if (headless) return;
+    if (capture_active() && !software) {
+        // Flush the batch so the read sees the whole frame before the swap
+        rlDrawRenderBatchActive();
+        capture_gpu();
+    }
+#endif
+    EndDrawing();
+}
+
+
+float frame_time(void)
+{
+#ifndef PLATFORM_WEB
+    if (headless) return headless_dt;
+#endif
+    return GetFrameTime();
+}
+
+
+Vector2 mouse_position(void)
+{
+#ifdef PLATFORM_WEB
+    return input.mouse;
+#else
+    if (headless) return (Vector2){0};
+    return GetMousePosition();
+#endif
+}
+
+
+Vector2 mouse_delta(void)
+{
+#ifdef PLATFORM_WEB
+    return input.mouse_delta;
+#else
+    if (headless) return (Vector2){0};
+    return GetMouseDelta();
+#endif
+}
+
+
+bool mouse_pressed(int button)
+{
+#ifdef PLATFORM_WEB
+    if (button < 0 || button >= 32) return false;
+    return (input.buttons_pressed >> button) & 1;
+#else
+    if (headless) return false;
+    return IsMouseButtonPressed(button);
+#endif
+}
+
+
+bool key_pressed(int key)
+{
+#ifdef PLATFORM_WEB
+    if (key < 0 || key >= INPUT_KEY_WORDS*32) return false;
+    return (input.keys_pressed[key/32] >> (key%32)) & 1;
+#else
+    if (headless) return false;
+    return IsKeyPressed(key);
+#endif
+}
+
+
+#ifdef PLATFORM_WEB
+// raylib helpers
+// ------------------------------------------------------------
+// Pure functions that raylib.h declares as library exports. Natively they
+// come from libraylib; on the web they are defined here instead of being
+// imported from raylib.js, so the collision loop and particle fading never
+// leave the module. They can't be static since raylib.h already declared them.
+bool CheckCollisionCircles(Vector2 center1, float radius1, Vector2 center2, float radius2)
+{
+    float dx = center2.x - center1.x;
+    float dy = center2.y - center1.y;
+    float r = radius1 + radius2;
+    return dx*dx + dy*dy <= r*r;
+}
+
+
+bool CheckCollisionPointCircle(Vector2 point, Vector2 center, float radius)
+{
+    return CheckCollisionCircles(point, 0, center, radius);
+}
+
+
+bool CheckCollisionPointRec(Vector2 point, Rectangle rec)
+{
+    return point.x >= rec.x && point.x < rec.x + rec.width &&
+           point.y >= rec.y && point.y < rec.y + rec.height;
+}
+
+
+Color ColorAlpha(Color color, float alpha)
+{
+    if (alpha < 0.0f) alpha = 0.0f;
+    else if (alpha > 1.0f) alpha = 1.0f;
+    color.a = (unsigned char)(255.0f*alpha);
+    return color;
+}
+
+
+Color Fade(Color color, float alpha)
+{
+    return ColorAlpha(color, alpha);
+}
+// ------------------------------------------------------------
+#endif // PLATFORM_WEB
+
+
+#ifdef COMMAND_BUFFER
+// Draw command buffer
+// ------------------------------------------------------------
+// Every command is a run of 32-bit words starting with its op. Colors are
+// packed RGBA with red in the low byte, coordinates are floats. raylib.js
+// decodes the whole buffer in one pass at EndDrawing and resets count, so a
+// frame costs a couple of calls into JS no matter how much is drawn.
+//
+// The buffer lives on the heap and doubles when a frame doesn't fit, so it
+// settles at the size the busiest frame needs. Only past
+// COMMAND_BUFFER_MAX_WORDS, or when memory can't grow, is it flushed mid-frame.
+#define COMMAND_BUFFER_WORDS (1 << 12)
+#define COMMAND_BUFFER_MAX_WORDS (1 << 20)
+
+typedef enum {
+    COMMAND_CLEAR = 1,          // color
+    COMMAND_RECTANGLE,          // x, y, width, height, color
+    COMMAND_CIRCLE,             // x, y, radius, color
+    COMMAND_CIRCLE_GRADIENT,    // x, y, radius, inner color, outer color
+    COMMAND_TEXT,               // text pointer, x, y, font size, color
+} CommandOp;
+
+typedef struct {
+    unsigned int count;     // Words in use
+    unsigned int words[];
+} CommandBuffer;
+
+static CommandBuffer *commands = NULL;
+static unsigned int commands_capacity = 0;
+static CommandBuffer commands_fallback = {0};   // When even the first allocation fails, nothing is drawn
+
+void raylib_js_set_command_buffer(void *buffer, int capacity);
+void raylib_js_flush_commands(void);
+
+
+static bool grow_command_buffer(unsigned int capacity)
+{
+    CommandBuffer *grown = heap_realloc(commands, sizeof(CommandBuffer) + capacity*sizeof(unsigned int));
+    if (grown == NULL) return false;
+    commands = grown;
+    commands_capacity = capacity;
+    raylib_js_set_command_buffer(commands, capacity);
+    return true;
+}
+
+
+void init_command_buffer(void)
+{
+    if (grow_command_buffer(COMMAND_BUFFER_WORDS)) return;
+    commands = &commands_fallback;
+    raylib_js_set_command_buffer(commands, 0);
+}
+
+
+unsigned int *push_command(CommandOp op, int words)
+{
+    static unsigned int discard[8];
+    if (commands->count + words > commands_capacity) {
+        unsigned int capacity = commands_capacity*2;
+        while (capacity != 0 && capacity < commands->count + words) capacity *= 2;
+        if (capacity == 0 || capacity > COMMAND_BUFFER_MAX_WORDS || !grow_command_buffer(capacity)) {
+            raylib_js_flush_commands();
+            if ((unsigned int)words > commands_capacity) return discard;
+        }
+    }
+    unsigned int *command = &commands->words[commands->count];
+    command[0] = op;
+    commands->count += words;
+    return command;
+}
+
+
+unsigned int command_color(Color color)
+{
+    return (unsigned int)color.r | (unsigned int)color.g << 8 | (unsigned int)color.b << 16 | (unsigned int)color.a << 24;
+}
+
+
+unsigned int command_float(float x)
+{
+    union { float f; unsigned int u; } bits = { .f = x };
+    return bits.u;
+}
+// ------------------------------------------------------------
+#else
+
+void init_command_buffer(void) {}
+
+#endif // COMMAND_BUFFER
+
+
+void clear_background(Color color)
+{
+#ifdef COMMAND_BUFFER
+    unsigned int *command = push_command(COMMAND_CLEAR, 2);
+    command[1] = command_color(color);
+    return;
+#endif
+#ifdef SOFTWARE_RENDER
+    if (software) {
+        swr_clear(color);
+        return;
+    }
+#endif
+    ClearBackground(color);
+}
+
+
+void draw_rectangle(int x, int y, int w, int h, Color color)
+{
+#ifdef COMMAND_BUFFER
+    unsigned int *command = push_command(COMMAND_RECTANGLE, 6);
+    command[1] = command_float(x);
+    command[2] = command_float(y);
+    command[3] = command_float(w);
+    command[4] = command_float(h);
+    command[5] = command_color(color);
+    return;
+#endif
+#ifdef SOFTWARE_RENDER
+    if (software) {
+        swr_rectangle(x, y, w, h, color);
+        return;
+    }
+#endif
+    DrawRectangle(x, y, w, h, color);
+}
+
+
+void draw_text(const char *text, int x, int y, int font_size, Color color)
+{
+#ifdef COMMAND_BUFFER
+    unsigned int *command = push_command(COMMAND_TEXT, 6);
+    command[1] = (unsigned int)text;
+    command[2] = command_float(x);
+    command[3] = command_float(y);
+    command[4] = command_float(font_size);
+    command[5] = command_color(color);
+    return;
+#endif
+#ifdef SOFTWARE_RENDER
+    if (software) {
+        swr_text(text, x, y, font_size, color);
+        return;
+    }
+#endif
+    DrawText(text, x, y, font_size, color);
+}
+// ------------------------------------------------------------
 
 static Color colors[] = {GRUVBOX_RED, GRUVBOX_GREEN, GRUVBOX_YELLOW, GRUVBOX_BLUE, GRUVBOX_PURPLE, GRUVBOX_AQUA, GRUVBOX_ORANGE};
 //static Color colors[] = {RED, YELLOW, GREEN, PURPLE, BROWN, PINK, ORANGE, GOLD, BLUE, VIOLET};
@@ -88,6 +483,324 @@ static Circle circles[CIRCLES] = {0};
 static bool is_circles_move = true;
 
 
+// Ball rendering
+// ------------------------------------------------------------
+// Natively balls and particles are drawn as quads and the circle edge is
+// computed in the fragment shader from the signed distance to the center,
+// so every primitive gets its own antialiasing and MSAA can stay off.
+// The web build (and --msaa) keep using the regular circle geometry.
+#ifndef PLATFORM_WEB
+
+// The quad texcoords carry the position inside the circle in [-1, 1] units.
+// The default vertex shader only forwards texcoord and color, so the alpha of
+// the outer edge is packed into texcoord.x in steps of 8: u = x + 8*outer_alpha.
+static const char *sdf_fs_code =
+    "#version 330\n"
+    "in vec2 fragTexCoord;\n"
+    "in vec4 fragColor;\n"
+    "out vec4 finalColor;\n"
+    "void main()\n"
+    "{\n"
+    "    float outer = floor((fragTexCoord.x + 4.0)/8.0);\n"
+    "    vec2 p = vec2(fragTexCoord.x - outer*8.0, fragTexCoord.y);\n"
+    "    float d = length(p);\n"
+    "    float aa = fwidth(d);\n"
+    "    float edge = 1.0 - smoothstep(1.0 - aa, 1.0, d);\n"
+    "    float alpha = mix(fragColor.a, outer/255.0, clamp(d, 0.0, 1.0));\n"
+    "    finalColor = vec4(fragColor.rgb, alpha*edge);\n"
+    "}\n";
+
+static Shader sdf_shader = {0};
+
+// Balls are only recorded while the frame is simulated. At the end the
+// vertices are generated on the job threads, each job filling its own slice
+// of ball_vertices, and the GL thread just uploads and draws them at once.
+typedef struct {
+    Vector2 center;
+    float radius;
+    Color color;
+    unsigned char outer_alpha;
+} Ball;
+
+typedef struct {
+    float x, y;
+    float u, v;
+    unsigned char r, g, b, a;
+} BallVertex;
+
+#define BALL_VERTICES 6     // Two triangles per quad
+#define BALLS_PER_JOB 512
+
+static Ball *balls = NULL;
+static int balls_count = 0;
+static int balls_capacity = 0;
+static BallVertex *ball_vertices = NULL;
+
+static unsigned int ball_vao = 0;
+static unsigned int ball_vbo = 0;
+static int ball_vbo_capacity = 0;   // In balls
+
+
+void init_ball_rendering(void)
+{
+    if (msaa || software) return;
+    sdf_shader = LoadShaderFromMemory(NULL, sdf_fs_code);
+    ball_vao = rlLoadVertexArray();
+}
+
+
+void deinit_ball_rendering(void)
+{
+    if (msaa || software) return;
+    if (ball_vbo != 0) rlUnloadVertexBuffer(ball_vbo);
+    rlUnloadVertexArray(ball_vao);
+    UnloadShader(sdf_shader);
+    free(balls);
+    free(ball_vertices);
+}
+
+
+void begin_ball_rendering(void)
+{
+    balls_count = 0;
+}
+
+
+void generate_ball_vertices(void *ctx, int job)
+{
+    (void) ctx;
+    int first = job*BALLS_PER_JOB;
+    int last = first + BALLS_PER_JOB < balls_count ? first + BALLS_PER_JOB : balls_count;
+
+    for (int i = first; i < last; ++i) {
+        const Ball *ball = &balls[i];
+        // One pixel of padding around the disc leaves room for the smoothed edge
+        float pad = fminf(1.0f, ball->radius);
+        float size = ball->radius + pad;
+        float s = size/ball->radius;
+        float u = 8.0f*ball->outer_alpha;
+
+        float x0 = ball->center.x - size, x1 = ball->center.x + size;
+        float y0 = ball->center.y - size, y1 = ball->center.y + size;
+        Color c = ball->color;
+        BallVertex *v = &ball_vertices[i*BALL_VERTICES];
+        v[0] = (BallVertex){x0, y0, u - s, -s, c.r, c.g, c.b, c.a};
+        v[1] = (BallVertex){x0, y1, u - s,  s, c.r, c.g, c.b, c.a};
+        v[2] = (BallVertex){x1, y1, u + s,  s, c.r, c.g, c.b, c.a};
+        v[3] = v[0];
+        v[4] = v[2];
+        v[5] = (BallVertex){x1, y0, u + s, -s, c.r, c.g, c.b, c.a};
+    }
+}
+
+
+void reserve_ball_vbo(int count)
+{
+    if (count <= ball_vbo_capacity) return;
+    while (ball_vbo_capacity < count) ball_vbo_capacity = ball_vbo_capacity == 0 ? 1024 : ball_vbo_capacity*2;
+
+    rlEnableVertexArray(ball_vao);
+    if (ball_vbo != 0) rlUnloadVertexBuffer(ball_vbo);
+    ball_vbo = rlLoadVertexBuffer(NULL, ball_vbo_capacity*BALL_VERTICES*sizeof(BallVertex), true);
+
+    int stride = sizeof(BallVertex);
+    int position = sdf_shader.locs[SHADER_LOC_VERTEX_POSITION];
+    int texcoord = sdf_shader.locs[SHADER_LOC_VERTEX_TEXCOORD01];
+    int color = sdf_shader.locs[SHADER_LOC_VERTEX_COLOR];
+    rlSetVertexAttribute(position, 2, RL_FLOAT, false, stride, (void *)0);
+    rlEnableVertexAttribute(position);
+    rlSetVertexAttribute(texcoord, 2, RL_FLOAT, false, stride, (void *)(2*sizeof(float)));
+    rlEnableVertexAttribute(texcoord);
+    rlSetVertexAttribute(color, 4, RL_UNSIGNED_BYTE, true, stride, (void *)(4*sizeof(float)));
+    rlEnableVertexAttribute(color);
+    rlDisableVertexArray();
+}
+
+
+void end_ball_rendering(void)
+{
+    if (msaa || software || balls_count == 0) return;
+
+    int job_count = (balls_count + BALLS_PER_JOB - 1)/BALLS_PER_JOB;
+    jobs_parallel_for(job_count, generate_ball_vertices, NULL);
+
+    // Anything already batched (the background) has to land before the balls
+    rlDrawRenderBatchActive();
+    reserve_ball_vbo(balls_count);
+
+    rlEnableShader(sdf_shader.id);
+    Matrix mvp = MatrixMultiply(rlGetMatrixModelview(), rlGetMatrixProjection());
+    rlSetUniformMatrix(sdf_shader.locs[SHADER_LOC_MATRIX_MVP], mvp);
+    rlEnableVertexArray(ball_vao);
+    rlUpdateVertexBuffer(ball_vbo, ball_vertices, balls_count*BALL_VERTICES*sizeof(BallVertex), 0);
+    rlDrawVertexArray(0, balls_count*BALL_VERTICES);
+    rlDisableVertexArray();
+    rlDisableShader();
+}
+
+
+void draw_ball_quad(Vector2 center, float radius, Color color, unsigned char outer_alpha)
+{
+    if (balls_count >= balls_capacity) {
+        balls_capacity = balls_capacity == 0 ? 1024 : balls_capacity*2;
+        balls = realloc(balls, balls_capacity*sizeof(*balls));
+        ball_vertices = realloc(ball_vertices, balls_capacity*BALL_VERTICES*sizeof(*ball_vertices));
+    }
+    balls[balls_count++] = (Ball){center, radius, color, outer_alpha};
+}
+
+#else
+
+void init_ball_rendering(void) {}
+void deinit_ball_rendering(void) {}
+void begin_ball_rendering(void) {}
+void end_ball_rendering(void) {}
+
+#endif // PLATFORM_WEB
+
+
+void draw_ball(Vector2 center, float radius, Color color)
+{
+#ifdef COMMAND_BUFFER
+    unsigned int *command = push_command(COMMAND_CIRCLE, 5);
+    command[1] = command_float(center.x);
+    command[2] = command_float(center.y);
+    command[3] = command_float(radius);
+    command[4] = command_color(color);
+    return;
+#endif
+#ifdef SOFTWARE_RENDER
+    if (software) {
+        swr_circle(center, radius, color);
+        return;
+    }
+#endif
+#ifndef PLATFORM_WEB
+    if (!msaa) {
+        draw_ball_quad(center, radius, color, color.a);
+        return;
+    }
+#endif
+    DrawCircleV(center, radius, color);
+}
+
+
+// Gradient from color in the center to color with outer_alpha on the edge
+void draw_ball_gradient(Vector2 center, float radius, Color color, float outer_alpha)
+{
+    Color outer = ColorAlpha(color, outer_alpha);
+#ifdef COMMAND_BUFFER
+    unsigned int *command = push_command(COMMAND_CIRCLE_GRADIENT, 6);
+    command[1] = command_float(center.x);
+    command[2] = command_float(center.y);
+    command[3] = command_float(radius);
+    command[4] = command_color(color);
+    command[5] = command_color(outer);
+    return;
+#endif
+#ifdef SOFTWARE_RENDER
+    if (software) {
+        swr_circle_gradient(center, radius, color, outer);
+        return;
+    }
+#endif
+#ifndef PLATFORM_WEB
+    if (!msaa) {
+        draw_ball_quad(center, radius, color, outer.a);
+        return;
+    }
+#endif
+    DrawCircleGradient(center.x, center.y, radius, color, outer);
+}
+// ------------------------------------------------------------
+
+
+// Trails
+// ------------------------------------------------------------
+// In trail mode the scene is never cleared. Every frame one translucent
+// full-screen rectangle fades what is already there and the new frame is
+// drawn on top, so everything leaves an afterglow and the mouse trail is a
+// stroke of dots instead of hundreds of simulated particles.
+// The canvas and the software framebuffer keep their pixels between frames
+// by themselves, the GPU path renders the scene into a render texture.
+#define TRAIL_FADE 0.15f
+#define TRAIL_RADIUS 3.0f
+#define TRAIL_SPACING 2.0f
+
+static bool trails_reset = true;    // The next trail frame starts from a cleared scene
+static int trail_color = 0;
+#ifndef PLATFORM_WEB
+static RenderTexture2D trail_target = {0};
+#endif
+
+
+void toggle_trails(void)
+{
+    trails = !trails;
+    trails_reset = true;
+}
+
+
+void begin_scene(void)
+{
+#ifndef PLATFORM_WEB
+    if (trails && !software) {
+        if (trail_target.id == 0 || trail_target.texture.width != width || trail_target.texture.height != height) {
+            if (trail_target.id != 0) UnloadRenderTexture(trail_target);
+            trail_target = LoadRenderTexture(width, height);
+            trails_reset = true;
+        }
+        BeginTextureMode(trail_target);
+    }
+#endif
+    if (trails && !trails_reset) {
+        draw_rectangle(0, 0, width, height, ColorAlpha(RAYWHITE, TRAIL_FADE));
+    } else {
+        clear_background(RAYWHITE);
+        trails_reset = false;
+    }
+}
+
+
+void end_scene(void)
+{
+#ifndef PLATFORM_WEB
+    if (trails && !software) {
+        EndTextureMode();
+        // Copy the scene as is, blending it would bring in the texture's alpha
+        rlSetBlendFactors(RL_ONE, RL_ZERO, RL_FUNC_ADD);
+        BeginBlendMode(BLEND_CUSTOM);
+        DrawTextureRec(trail_target.texture, (Rectangle){0, 0, width, -height}, (Vector2){0}, WHITE);
+        EndBlendMode();
+    }
+#endif
+}
+
+
+void deinit_trails(void)
+{
+#ifndef PLATFORM_WEB
+    if (trail_target.id != 0) UnloadRenderTexture(trail_target);
+#endif
+}
+
+
+void draw_trail(Vector2 from, Vector2 to)
+{
+    float dx = to.x - from.x;
+    float dy = to.y - from.y;
+    // Spacing along the longer axis is close enough and needs no sqrtf on the web
+    float distance = dx*dx > dy*dy ? (dx < 0 ? -dx : dx) : (dy < 0 ? -dy : dy);
+    int steps = (int)(distance/TRAIL_SPACING) + 1;
+    Color color = colors[trail_color++/8 % colors_count];
+    for (int i = 1; i <= steps; ++i) {
+        float t = (float)i/steps;
+        draw_ball((Vector2){from.x + dx*t, from.y + dy*t}, TRAIL_RADIUS, color);
+    }
+}
+// ------------------------------------------------------------
+
+
 void init_mouse_particles(void)
 {
     for (int i = 0; i < MOUSE_PARTICLES; ++i) {
@@ -125,6 +838,24 @@ void update_particle_pos(Particle particles[], int particles_size, int index, fl
     if (index < 0 || index >= particles_size) return;
     Particle *particle = &particles[index];
 
+#ifdef __wasm_simd128__
+    // pos and velocity are adjacent, so x and y go side by side in the low
+    // lanes and the velocity rides along in the high ones. Same float math as
+    // the scalar version below, lane by lane.
+    v128_t state = wasm_v128_load(&particle->pos);
+    v128_t velocity = wasm_i32x4_shuffle(state, state, 2, 3, 2, 3);
+    v128_t next = wasm_f32x4_add(state, wasm_f32x4_mul(velocity, wasm_f32x4_splat(dt)));
+    v128_t radius = wasm_f32x4_splat(particle->radius);
+    v128_t bounds = wasm_f32x4_make((float)width, (float)height, 0.0f, 0.0f);
+    v128_t outside = wasm_v128_or(
+        wasm_f32x4_lt(wasm_f32x4_sub(next, radius), wasm_f32x4_splat(0.0f)),
+        wasm_f32x4_gt(wasm_f32x4_add(next, radius), bounds));
+    // Bounce lanes keep their position and flip their velocity
+    v128_t bounce = wasm_i32x4_shuffle(outside, outside, 0, 1, 0, 1);
+    v128_t moved = wasm_i32x4_shuffle(next, state, 0, 1, 6, 7);
+    v128_t flipped = wasm_i32x4_shuffle(state, wasm_f32x4_neg(state), 0, 1, 6, 7);
+    wasm_v128_store(&particle->pos, wasm_v128_bitselect(flipped, moved, bounce));
+#else
     float x = particle->pos.x + particle->velocity.x*dt;
     if (x - particle->radius < 0 || x + particle->radius > width) {
         particle->velocity.x *= -1;
@@ -138,16 +869,26 @@ void update_particle_pos(Particle particles[], int particles_size, int index, fl
     } else {
         particle->pos.y = y;
     }
+#endif
 }
 
 
-void draw_particles(Particle particles[], int particles_count, float dt)
+void draw_particles(Particle particles[], int particles_count)
 {
     for (int i = 0; i < particles_count; ++i) {
         Particle *particle = &particles[i];
         if (particle->lifetime <= 0) continue;
         float value = particle->lifetime / particle->max_lifetime;
-        DrawCircleV(particle->pos, particle->radius, ColorAlpha(particle->color, value));
+        draw_ball(particle->pos, particle->radius, ColorAlpha(particle->color, value));
+    }
+}
+
+
+void update_particles(Particle particles[], int particles_count, float dt)
+{
+    for (int i = 0; i < particles_count; ++i) {
+        Particle *particle = &particles[i];
+        if (particle->lifetime <= 0) continue;
         update_particle_pos(particles, particles_count, i, dt);
         particle->lifetime -= dt;
     }
@@ -211,35 +952,102 @@ void print_circle(int index)
 }
 */
 
-bool update_circle_collision(int index, float x, float y)
+// First moving circle the one at index would touch at (x, y), -1 for none.
+// Only reads circles, so it's safe to call from the job threads.
+int find_circle_collision(int index, float x, float y)
 {
     Vector2 pos = {.x = x, .y = y};
     float radius = circles[index].radius;
-    for (int i = 0; i < CIRCLES; ++i) {
+    int first = 0;
+
+#ifdef __wasm_simd128__
+    // CheckCollisionCircles() on four circles at a time
+    v128_t px = wasm_f32x4_splat(x), py = wasm_f32x4_splat(y);
+    v128_t r1 = wasm_f32x4_splat(radius);
+    for (; first + 4 <= CIRCLES; first += 4) {
+        const Circle *c = &circles[first];
+        v128_t dx = wasm_f32x4_sub(wasm_f32x4_make(c[0].pos.x, c[1].pos.x, c[2].pos.x, c[3].pos.x), px);
+        v128_t dy = wasm_f32x4_sub(wasm_f32x4_make(c[0].pos.y, c[1].pos.y, c[2].pos.y, c[3].pos.y), py);
+        v128_t r = wasm_f32x4_add(r1, wasm_f32x4_make(c[0].radius, c[1].radius, c[2].radius, c[3].radius));
+        v128_t hit = wasm_v128_and(
+            wasm_f32x4_le(wasm_f32x4_add(wasm_f32x4_mul(dx, dx), wasm_f32x4_mul(dy, dy)), wasm_f32x4_mul(r, r)),
+            wasm_i32x4_eq(wasm_i32x4_make(c[0].state, c[1].state, c[2].state, c[3].state), wasm_i32x4_splat(MOVE)));
+        int mask = wasm_i32x4_bitmask(hit);
+        if (index >= first && index < first + 4) mask &= ~(1 << (index - first));
+        if (mask != 0) return first + __builtin_ctz(mask);
+    }
+#endif
+
+    for (int i = first; i < CIRCLES; ++i) {
         if (i == index) continue;
         Circle *circle = &circles[i];
         if (circle->state != MOVE) continue;
-        if (CheckCollisionCircles(pos, radius, circle->pos, circle->radius)) {
-            if (pop_on_collision) {
-                circle->state = POP;
-                circle->timer = 0.0f;
-                init_circle_particles(i);
-
-                circles[index].state = POP;
-                circles[index].timer = 0.0f;
-                init_circle_particles(index);
-                return true;
-            } 
+        if (CheckCollisionCircles(pos, radius, circle->pos, circle->radius)) return i;
+    }
+    return -1;
+}
+
+bool collide_circles(int index, int other)
+{
+    Circle *circle = &circles[other];
+    if (pop_on_collision) {
+        circle->state = POP;
+        circle->timer = 0.0f;
+        init_circle_particles(other);
+
+        circles[index].state = POP;
+        circles[index].timer = 0.0f;
+        init_circle_particles(index);
+        return true;
+    } 
 #ifdef COLLISION  
-            else {
-                circle->velocity = Vector2Negate(circle->velocity);  
-                circles[index].velocity = Vector2Negate(circles[index].velocity);  
-                return true;
-            }
+    else {
+        circle->velocity = Vector2Negate(circle->velocity);  
+        circles[index].velocity = Vector2Negate(circles[index].velocity);  
+        return true;
+    }
 #endif
+    return false;
+}
+
+bool update_circle_collision(int index, float x, float y)
+{
+    int other = find_circle_collision(index, x, y);
+    return other >= 0 && collide_circles(index, other);
+}
+
+// Whether anything is close enough that a circle might run into it this
+// frame, worked out by step_circles() on the job threads against the
+// positions at the start of the frame. Circles are still moved and collided
+// one after another against the current positions, as before, the search is
+// only skipped for circles that nothing can reach: within the frame a circle
+// moves once by at most its speed, its velocity may be flipped and both radii
+// may grow under the mouse, which the margin covers.
+typedef struct {
+    float dt;
+    float margin;
+} CircleStep;
+
+static bool circle_near[CIRCLES];
+
+#define CIRCLES_PER_JOB 8
+
+void step_circles(void *ctx, int job)
+{
+    CircleStep *step = ctx;
+    int end = (job + 1)*CIRCLES_PER_JOB < CIRCLES ? (job + 1)*CIRCLES_PER_JOB : CIRCLES;
+    for (int i = job*CIRCLES_PER_JOB; i < end; ++i) {
+        Circle *circle = &circles[i];
+        circle_near[i] = false;
+        if (circle->state != MOVE && circle->state != BORN) continue;
+
+        // BORN circles count too, they turn into MOVE during the frame
+        Vector2 pos = {circle->pos.x + circle->velocity.x*step->dt, circle->pos.y + circle->velocity.y*step->dt};
+        for (int j = 0; j < CIRCLES && !circle_near[i]; ++j) {
+            if (j == i || (circles[j].state != MOVE && circles[j].state != BORN)) continue;
+            circle_near[i] = CheckCollisionCircles(pos, circle->radius + step->margin, circles[j].pos, circles[j].radius);
         }
     }
-    return false;
 }
 
 void update_circle_pos(int index, float dt) 
@@ -250,7 +1058,7 @@ void update_circle_pos(int index, float dt)
     float x = circle->pos.x + circle->velocity.x*dt;
     float y = circle->pos.y + circle->velocity.y*dt;
     
-    if (update_circle_collision(index, x, y)) {
+    if (circle_near[index] && update_circle_collision(index, x, y)) {
         return;
     }
        
@@ -281,12 +1089,16 @@ void update_circle_pos(int index, float dt)
 }
 
 
-void draw_circle_move(int index, float dt) 
+void draw_circle_move(int index) 
 {
     Circle *circle = &circles[index];
-    DrawCircleGradient(circle->pos.x, circle->pos.y, circle->radius, circle->color, ColorAlpha(circle->color, 0.5));
+    draw_ball_gradient(circle->pos, circle->radius, circle->color, 0.5f);
+}
 
-    if (CheckCollisionPointCircle(GetMousePosition(), circle->pos, circle->radius)) {
+void update_circle_move(int index, float dt) 
+{
+    Circle *circle = &circles[index];
+    if (CheckCollisionPointCircle(mouse_position(), circle->pos, circle->radius)) {
         circle->radius += dt*50;
         if (circle->radius > circle_radius_max + 10) {
             circle->state = POP;
@@ -299,22 +1111,23 @@ void draw_circle_move(int index, float dt)
 }
 
 
-void draw_circle_pop(int index, float dt) {
+void draw_circle_pop(int index) {
     Circle *circle = &circles[index];
-    circle->timer += dt;
     //float radius = circle->radius * circle->timer / 1.0f; 
     //DrawRing(circle->pos, radius, circle->radius, 0, 360, 360, ColorAlpha(circle->color, 0.5f));
-    draw_particles(circle->particles, PARTICLES, dt); 
+    draw_particles(circle->particles, PARTICLES); 
+}
 
-    //update_circle_pos(index, dt); 
-    
+void update_circle_pop(int index, float dt) {
+    Circle *circle = &circles[index];
+    circle->timer += dt;
     if (circle->timer > 1.0f) {
         rand_circle(index);
         circle->state = VANISH;
     }
 }
 
-void draw_circle_vanish(int index, float dt) {
+void update_circle_vanish(int index, float dt) {
     Circle *circle = &circles[index];
     circle->timer += dt;
     if (circle->timer > 1.0f) {
@@ -324,14 +1137,18 @@ void draw_circle_vanish(int index, float dt) {
 }
 
 
-void draw_circle_born(int index, float dt)
+void draw_circle_born(int index)
 {
     Circle *circle = &circles[index];
-    circle->timer += dt;
     float value = circle->timer / 0.75f; 
     float radius = circle->radius * value; 
-    DrawCircleGradient(circle->pos.x, circle->pos.y, radius, circle->color, ColorAlpha(circle->color, 0.5f));
-    
+    draw_ball_gradient(circle->pos, radius, circle->color, 0.5f);
+}
+
+void update_circle_born(int index, float dt)
+{
+    Circle *circle = &circles[index];
+    circle->timer += dt;
     update_circle_pos(index, dt); 
     
     if (circle->timer > 0.75f) {
@@ -339,6 +1156,56 @@ void draw_circle_born(int index, float dt)
     }
 }
 
+
+// Every particle, the ones of all popping circles followed by the mouse ones,
+// updated in fixed size slices on the job threads
+#define PARTICLES_PER_JOB 256
+#define ALL_PARTICLES (CIRCLES*PARTICLES + MOUSE_PARTICLES)
+
+void update_particles_job(void *ctx, int job)
+{
+    float dt = *(float *)ctx;
+    int end = (job + 1)*PARTICLES_PER_JOB < ALL_PARTICLES ? (job + 1)*PARTICLES_PER_JOB : ALL_PARTICLES;
+    for (int i = job*PARTICLES_PER_JOB; i < end;) {
+        if (i < CIRCLES*PARTICLES) {
+            Circle *circle = &circles[i/PARTICLES];
+            int first = i%PARTICLES;
+            int count = (end - i < PARTICLES - first ? end - i : PARTICLES - first);
+            if (circle->state == POP) update_particles(circle->particles + first, count, dt);
+            i += count;
+        } else {
+            update_particles(particles + (i - CIRCLES*PARTICLES), end - i, dt);
+            i = end;
+        }
+    }
+}
+
+
+// The frame is drawn from the state at its start and then advanced. Moving
+// particles and finding which circles have anything nearby don't depend on
+// each other and run as jobs, everything that calls rand() or changes another
+// circle stays on this thread, in circle order.
+void update_world(float dt)
+{
+    jobs_parallel_for((ALL_PARTICLES + PARTICLES_PER_JOB - 1)/PARTICLES_PER_JOB, update_particles_job, &dt);
+    if (is_circles_move) {
+        float speed = 0.0f;
+        for (int i = 0; i < CIRCLES; ++i) speed = fmaxf(speed, Vector2Length(circles[i].velocity));
+        CircleStep step = {.dt = dt, .margin = (3*speed + 2*50)*dt + 1.0f};
+        jobs_parallel_for((CIRCLES + CIRCLES_PER_JOB - 1)/CIRCLES_PER_JOB, step_circles, &step);
+    }
+
+    for (int i = 0; i < CIRCLES; ++i) {
+        switch (circles[i].state) {
+            case POP: update_circle_pop(i, dt); break;
+            case VANISH: update_circle_vanish(i, dt); break;
+            case BORN: update_circle_born(i, dt); break;
+            case MOVE: update_circle_move(i, dt); break;
+            default: break;
+        }
+    }
+}
+
 /*
 void procees_slider(int cx, int cy)
 {
@@ -357,7 +1224,7 @@ void procees_slider(int cx, int cy)
 
 void draw_menu(void) 
 {
-    Vector2 mouse = GetMousePosition();
+    Vector2 mouse = mouse_position();
     int x = 10, y = 10;
     int text_size = 20;
 /*    
@@ -374,15 +1241,15 @@ void draw_menu(void)
     Color color = BLACK; //pop_on_collision ? RED : BLACK;
     int pop_on_collision_text_x = pop_on_collision_rec.x + 10 + pop_on_collision_rec.width;
     int pop_on_collision_text_y = pop_on_collision_rec.y + pop_on_collision_rec.height/2 - text_size/2;
-    DrawRectangleRec(pop_on_collision_rec, color);
-    DrawText("Pop on collision", pop_on_collision_text_x, pop_on_collision_text_y, text_size, RED);
+    draw_rectangle(pop_on_collision_rec.x, pop_on_collision_rec.y, pop_on_collision_rec.width, pop_on_collision_rec.height, color);
+    draw_text("Pop on collision", pop_on_collision_text_x, pop_on_collision_text_y, text_size, RED);
     if (pop_on_collision) {
-        DrawRectangle(pop_on_collision_rec.x+5, pop_on_collision_rec.y+5, pop_on_collision_rec.width-10, pop_on_collision_rec.height-10, GREEN);
+        draw_rectangle(pop_on_collision_rec.x+5, pop_on_collision_rec.y+5, pop_on_collision_rec.width-10, pop_on_collision_rec.height-10, GREEN);
     } else {
-        DrawRectangle(pop_on_collision_rec.x+5, pop_on_collision_rec.y+5, pop_on_collision_rec.width-10, pop_on_collision_rec.height-10, RED);
+        draw_rectangle(pop_on_collision_rec.x+5, pop_on_collision_rec.y+5, pop_on_collision_rec.width-10, pop_on_collision_rec.height-10, RED);
     }
 
-    if (CheckCollisionPointRec(mouse, pop_on_collision_rec) && IsMouseButtonPressed(MOUSE_LEFT_BUTTON)) {
+    if (CheckCollisionPointRec(mouse, pop_on_collision_rec) && mouse_pressed(MOUSE_LEFT_BUTTON)) {
         pop_on_collision = !pop_on_collision;
     }
 
@@ -394,20 +1261,18 @@ void draw_menu(void)
 
 void game_frame(void)
 {
-    BeginDrawing();
-    float dt = GetFrameTime();
-    height = GetScreenHeight();
-    width = GetScreenWidth();
+    begin_frame();
+    float dt = frame_time();
 
-    Vector2 mouse = GetMousePosition();
+    Vector2 mouse = mouse_position();
     
-    ClearBackground(RAYWHITE);
+    begin_scene();
+    begin_ball_rendering();
     for (int i = 0; i < CIRCLES; ++i) {
         switch (circles[i].state) {
-            case POP: draw_circle_pop(i, dt); break;
-            case VANISH: draw_circle_vanish(i, dt); break;
-            case BORN: draw_circle_born(i, dt); break;
-            case MOVE: draw_circle_move(i, dt); break; 
+            case POP: draw_circle_pop(i); break;
+            case BORN: draw_circle_born(i); break;
+            case MOVE: draw_circle_move(i); break; 
             default: break;
         }
         
@@ -417,45 +1282,198 @@ void game_frame(void)
         //} 
     }
     
-    Vector2 mouse_delta = GetMouseDelta();
-    if (mouse_delta.x != 0 || mouse_delta.y != 0) rand_mouse_particle(mouse); 
-    draw_particles(particles, MOUSE_PARTICLES, dt);
+    Vector2 delta = mouse_delta();
+    if (delta.x != 0 || delta.y != 0) {
+        if (trails) draw_trail((Vector2){mouse.x - delta.x, mouse.y - delta.y}, mouse);
+        else rand_mouse_particle(mouse);
+    }
+    draw_particles(particles, MOUSE_PARTICLES);
+    end_ball_rendering();
+    end_scene();
+
+    update_world(dt);
    
-    if (IsKeyPressed(KEY_SPACE)) {
+    if (key_pressed(KEY_SPACE)) {
         is_circles_move = !is_circles_move;
     }
+    if (key_pressed(KEY_T)) {
+        toggle_trails();
+    }
     draw_menu();
-    EndDrawing();
+    end_frame();
 }
 
 
 void raylib_js_set_entry(void (*entry)(void));
 
 
+#ifndef PLATFORM_WEB
+void usage(const char *program)
+{
+    fprintf(stderr, "Usage: %s [--msaa] [--size WxH] [--bench N] [--headless] [--threads N] [--seed S] [--dump FILE] [--capture PATH] [--trails]\n", program);
+    fprintf(stderr, "    --msaa       draw circle geometry with 4x MSAA instead of the SDF shader\n");
+    fprintf(stderr, "    --size WxH   window size, defaults to the monitor size (1920x1080 headless)\n");
+    fprintf(stderr, "    --bench N    run N frames without FPS cap and print the average frame time\n");
+    fprintf(stderr, "    --headless   no window, render on the CPU with the software rasterizer\n");
+    fprintf(stderr, "    --threads N  worker threads for rasterizing and vertex generation, defaults to one per CPU\n");
+    fprintf(stderr, "    --seed S     seed the random generator for reproducible runs\n");
+    fprintf(stderr, "    --dump FILE  write the last software rendered frame as a binary PPM\n");
+    fprintf(stderr, "    --capture PATH  record frames in the background to PATH.y4m or a PNG sequence like out/%%05d.png\n");
+    fprintf(stderr, "    --trails     start in trail mode, T toggles it at runtime\n");
+}
+
+
+bool parse_args(int argc, char **argv)
+{
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--msaa") == 0) {
+            msaa = true;
+        } else if (strcmp(argv[i], "--size") == 0 && i + 1 < argc) {
+            if (sscanf(argv[++i], "%dx%d", &window_width, &window_height) != 2) return false;
+        } else if (strcmp(argv[i], "--bench") == 0 && i + 1 < argc) {
+            bench_frames = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--headless") == 0) {
+            headless = true;
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = (unsigned int)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--dump") == 0 && i + 1 < argc) {
+            dump_path = argv[++i];
+        } else if (strcmp(argv[i], "--capture") == 0 && i + 1 < argc) {
+            capture_path = argv[++i];
+        } else if (strcmp(argv[i], "--trails") == 0) {
+            trails = true;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+
+bool should_close(void)
+{
+    return !headless && WindowShouldClose();
+}
+
+
+void run_bench(void)
+{
+    // Skip the first frames, they include shader compilation and window setup
+    int warmup = 60;
+    for (int i = 0; i < warmup && !should_close(); ++i) game_frame();
+
+    double start = now_seconds();
+    int frames = 0;
+    while (frames < bench_frames && !should_close()) {
+        game_frame();
+        frames += 1;
+    }
+    double elapsed = now_seconds() - start;
+    if (frames == 0) return;
+    const char *renderer = software ? "software" : msaa ? "msaa 4x" : "sdf";
+    printf("%dx%d %s: %d frames, %.3f ms/frame (%.1f FPS)\n",
+           width, height, renderer, frames, elapsed*1000.0/frames, frames/elapsed);
+}
+
+
+bool dump_frame(const char *path)
+{
+    FILE *f = fopen(path, "wb");
+    if (f == NULL) {
+        fprintf(stderr, "ERROR: could not open %s for writing\n", path);
+        return false;
+    }
+    int w = swr_width(), h = swr_height();
+    const unsigned char *pixels = swr_pixels();
+    fprintf(f, "P6\n%d %d\n255\n", w, h);
+    for (int i = 0; i < w*h; ++i) fwrite(&pixels[i*4], 1, 3, f);
+    fclose(f);
+    return true;
+}
+#endif // PLATFORM_WEB
+
+
+#ifdef PLATFORM_WEB
 int main(void)
+#else
+int main(int argc, char **argv)
+#endif
 {
     #ifndef PLATFORM_WEB
-        srand(time(NULL));
+        if (!parse_args(argc, argv)) {
+            usage(argv[0]);
+            return 1;
+        }
+        jobs_init(threads);
+        srand(seed != 0 ? seed : time(NULL));
         SetTraceLogLevel(LOG_WARNING);
-        SetConfigFlags(FLAG_WINDOW_RESIZABLE | FLAG_MSAA_4X_HINT);
+        if (headless) {
+            software = true;
+            if (window_width <= 0 || window_height <= 0) {
+                window_width = 1920;
+                window_height = 1080;
+            }
+            if (bench_frames <= 0) bench_frames = 600;
+            width = window_width;
+            height = window_height;
+        } else {
+            SetConfigFlags(FLAG_WINDOW_RESIZABLE | (msaa ? FLAG_MSAA_4X_HINT : 0));
+            InitWindow(window_width, window_height, "Balls");
+            SetTargetFPS(bench_frames > 0 ? 0 : 60);
+            width = GetScreenWidth();
+            height = GetScreenHeight();
+        }
+    #else
+        //InitWindow(WIDTH, HEIGHT, "Balls");
+        InitWindow(0, 0, "Balls");
+        SetTargetFPS(60);
+        raylib_js_set_input(&input);
+        width = GetScreenWidth();
+        height = GetScreenHeight();
     #endif
 
-    //InitWindow(WIDTH, HEIGHT, "Balls");
-    InitWindow(0, 0, "Balls");
-    SetTargetFPS(60);
-    width = GetScreenWidth();
-    height = GetScreenHeight();
-
+    init_command_buffer();
+    init_ball_rendering();
     init_circles();
     init_mouse_particles();
 
+#ifndef PLATFORM_WEB
+    if (capture_path != NULL) {
+        int capture_width = headless ? width : GetRenderWidth();
+        int capture_height = headless ? height : GetRenderHeight();
+        if (!capture_start(capture_path, capture_width, capture_height, 60, !headless)) return 1;
+    }
+#endif
+
 #ifdef PLATFORM_WEB
     raylib_js_set_entry(game_frame);
 #else 
-    while (!WindowShouldClose()) {
-            game_frame();
+    if (bench_frames > 0) {
+        run_bench();
+    } else {
+        while (!WindowShouldClose()) {
+                game_frame();
+        }
+    }
+    capture_stop();
+    if (dump_path != NULL && software && !dump_frame(dump_path)) return 1;
+
+    if (!headless) {
+        deinit_ball_rendering();
+        deinit_trails();
+        CloseWindow();
     }
-    CloseWindow();
+    jobs_shutdown();
 #endif
 
     return 0;
@@ -0,0 +1,325 @@
+// Asynchronous frame capture.
+//
+// Frames go into a ring of slots that a writer thread drains to disk, so the
+// render loop never waits on file IO. The ring is a single producer, single
+// consumer queue built on two atomic counters; when the writer falls behind
+// and the ring is full the frame is dropped and counted instead of blocking.
+// Offline captures (realtime = false, e.g. headless renders) wait instead, so
+// no frame is lost.
+//
+// GPU frames are read back through a ring of pixel buffer objects: the read
+// issued for frame N is only mapped CAPTURE_PBOS - 1 frames later, when the
+// transfer has long finished, so glReadPixels never stalls the pipeline.
+// Software rendered frames are simply copied into the next slot.
+//
+// Output is either a raw Y4M stream (path ending in .y4m) or a PNG sequence
+// (path containing a printf pattern for the frame number, e.g. out/%05d.png).
+//
+// Define CAPTURE_IMPLEMENTATION in exactly one file before including this header.
+#ifndef CAPTURE_H_
+#define CAPTURE_H_
+
+#include <stdbool.h>
+
+#define CAPTURE_SLOTS 8
+#define CAPTURE_PBOS 3
+
+bool capture_start(const char *path, int width, int height, int fps, bool realtime);
+void capture_pixels(const unsigned char *rgba, int width, int height);  // Top-down RGBA8 rows
+void capture_gpu(void);     // Read back the current framebuffer, call before swapping buffers
+void capture_stop(void);    // Finish pending reads, drain the ring and close the output
+bool capture_active(void);
+
+#endif // CAPTURE_H_
+
+#ifdef CAPTURE_IMPLEMENTATION
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define GL_GLEXT_PROTOTYPES
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+#include "raylib.h"
+
+static struct {
+    bool active;
+    bool realtime;
+    bool y4m;
+    const char *path;
+    FILE *out;
+    int width, height, fps;
+
+    unsigned char *slots[CAPTURE_SLOTS];
+    atomic_uint head;       // Frames pushed by the render thread
+    atomic_uint tail;       // Frames written by the writer thread
+    atomic_bool done;
+    pthread_t writer;
+    unsigned int written;
+    unsigned int dropped;
+
+    GLuint pbos[CAPTURE_PBOS];
+    unsigned int pbo_frames;    // Reads issued into the PBO ring
+    unsigned char *yuv;         // Writer thread scratch for one Y4M frame
+} capture = {0};
+
+
+static void capture_write_y4m(const unsigned char *rgba)
+{
+    // BT.601 full range, chroma averaged over 2x2 blocks
+    int w = capture.width & ~1, h = capture.height & ~1;
+    unsigned char *y_plane = capture.yuv;
+    unsigned char *u_plane = y_plane + w*h;
+    unsigned char *v_plane = u_plane + (w/2)*(h/2);
+
+    for (int y = 0; y < h; ++y) {
+        const unsigned char *row = &rgba[y*capture.width*4];
+        for (int x = 0; x < w; ++x) {
+            const unsigned char *p = &row[x*4];
+            y_plane[y*w + x] = (unsigned char)((77*p[0] + 150*p[1] + 29*p[2] + 128) >> 8);
+        }
+    }
+    for (int y = 0; y < h; y += 2) {
+        const unsigned char *row0 = &rgba[y*capture.width*4];
+        const unsigned char *row1 = row0 + capture.width*4;
+        for (int x = 0; x < w; x += 2) {
+            int r = row0[x*4 + 0] + row0[x*4 + 4] + row1[x*4 + 0] + row1[x*4 + 4];
+            int g = row0[x*4 + 1] + row0[x*4 + 5] + row1[x*4 + 1] + row1[x*4 + 5];
+            int b = row0[x*4 + 2] + row0[x*4 + 6] + row1[x*4 + 2] + row1[x*4 + 6];
+            int u = (-43*r - 85*g + 128*b + 4*128*256 + 512) >> 10;
+            int v = (128*r - 107*g - 21*b + 4*128*256 + 512) >> 10;
+            u_plane[(y/2)*(w/2) + x/2] = (unsigned char)(u < 0 ? 0 : u > 255 ? 255 : u);
+            v_plane[(y/2)*(w/2) + x/2] = (unsigned char)(v < 0 ? 0 : v > 255 ? 255 : v);
+        }
+    }
+
+    fputs("FRAME\n", capture.out);
+    fwrite(capture.yuv, 1, w*h + 2*(w/2)*(h/2), capture.out);
+}
+
+
+static void capture_write_png(const unsigned char *rgba)
+{
+    char path[1024];
+    snprintf(path, sizeof(path), capture.path, capture.written);
+    Image image = {
+        .data = (void *)rgba,
+        .width = capture.width,
+        .height = capture.height,
+        .mipmaps = 1,
+        .format = PIXELFORMAT_UNCOMPRESSED_R8G8B8A8,
+    };
+    if (!ExportImage(image, path)) fprintf(stderr, "ERROR: capture could not write %s\n", path);
+}
+
+
+static void *capture_writer(void *arg)
+{
+    (void) arg;
+    for (;;) {
+        unsigned int tail = atomic_load_explicit(&capture.tail, memory_order_relaxed);
+        unsigned int head = atomic_load_explicit(&capture.head, memory_order_acquire);
+        if (tail == head) {
+            if (atomic_load(&capture.done)) break;
+            struct timespec pause = { .tv_nsec = 1000000 };
+            nanosleep(&pause, NULL);
+            continue;
+        }
+
+        const unsigned char *frame = capture.slots[tail % CAPTURE_SLOTS];
+        if (capture.y4m) capture_write_y4m(frame);
+        else capture_write_png(frame);
+        capture.written += 1;
+
+        atomic_store_explicit(&capture.tail, tail + 1, memory_order_release);
+    }
+    return NULL;
+}
+
+
+// Buffers and output of a capture, also undoes a capture_start() that failed halfway
+static void capture_free(void)
+{
+    if (capture.out != NULL) fclose(capture.out);
+    capture.out = NULL;
+    for (int i = 0; i < CAPTURE_SLOTS; ++i) {
+        free(capture.slots[i]);
+        capture.slots[i] = NULL;
+    }
+    free(capture.yuv);
+    capture.yuv = NULL;
+}
+
+
+bool capture_start(const char *path, int width, int height, int fps, bool realtime)
+{
+    if (capture.active) return false;
+    size_t len = strlen(path);
+    capture.y4m = len > 4 && strcmp(path + len - 4, ".y4m") == 0;
+    if (!capture.y4m && strchr(path, '%') == NULL) {
+        fprintf(stderr, "ERROR: capture path must end in .y4m or contain a frame number pattern like %%05d.png\n");
+        return false;
+    }
+
+    capture.path = path;
+    capture.width = width;
+    capture.height = height;
+    capture.fps = fps;
+    capture.realtime = realtime;
+    capture.written = 0;
+    capture.dropped = 0;
+    capture.pbo_frames = 0;
+    atomic_store(&capture.head, 0);
+    atomic_store(&capture.tail, 0);
+    atomic_store(&capture.done, false);
+
+    if (capture.y4m) {
+        capture.out = fopen(path, "wb");
+        if (capture.out == NULL) {
+            fprintf(stderr, "ERROR: could not open %s for writing\n", path);
+            return false;
+        }
+        fprintf(capture.out, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", width & ~1, height & ~1, fps);
+        capture.yuv = malloc((size_t)width*height*3/2);
+        if (capture.yuv == NULL) {
+            fprintf(stderr, "ERROR: not enough memory to capture %dx%d\n", width, height);
+            capture_free();
+            return false;
+        }
+    }
+
+    for (int i = 0; i < CAPTURE_SLOTS; ++i) {
+        capture.slots[i] = malloc((size_t)width*height*4);
+        if (capture.slots[i] == NULL) {
+            fprintf(stderr, "ERROR: not enough memory to capture %dx%d\n", width, height);
+            capture_free();
+            return false;
+        }
+    }
+
+    if (pthread_create(&capture.writer, NULL, capture_writer, NULL) != 0) {
+        fprintf(stderr, "ERROR: could not start the capture writer thread\n");
+        capture_free();
+        return false;
+    }
+    capture.active = true;
+    return true;
+}
+
+
+bool capture_active(void)
+{
+    return capture.active;
+}
+
+
+// Next free slot. When the writer is behind the frame is dropped and NULL
+// returned, unless the caller is shutting down and can afford to wait.
+static unsigned char *capture_acquire(bool wait)
+{
+    unsigned int head = atomic_load_explicit(&capture.head, memory_order_relaxed);
+    while (head - atomic_load_explicit(&capture.tail, memory_order_acquire) >= CAPTURE_SLOTS) {
+        if (!wait) {
+            capture.dropped += 1;
+            return NULL;
+        }
+        struct timespec pause = { .tv_nsec = 1000000 };
+        nanosleep(&pause, NULL);
+    }
+    return capture.slots[head % CAPTURE_SLOTS];
+}
+
+
+static void capture_publish(void)
+{
+    unsigned int head = atomic_load_explicit(&capture.head, memory_order_relaxed);
+    atomic_store_explicit(&capture.head, head + 1, memory_order_release);
+}
+
+
+void capture_pixels(const unsigned char *rgba, int width, int height)
+{
+    if (!capture.active) return;
+    if (width != capture.width || height != capture.height) {
+        capture.dropped += 1;
+        return;
+    }
+    unsigned char *slot = capture_acquire(!capture.realtime);
+    if (slot == NULL) return;
+    memcpy(slot, rgba, (size_t)width*height*4);
+    capture_publish();
+}
+
+
+// Copy a finished PBO into the ring, flipping GL's bottom-up rows
+static void capture_map_pbo(GLuint pbo, bool wait)
+{
+    size_t stride = (size_t)capture.width*4;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+    const unsigned char *pixels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, stride*capture.height, GL_MAP_READ_BIT);
+    if (pixels != NULL) {
+        unsigned char *slot = capture_acquire(wait);
+        if (slot != NULL) {
+            for (int y = 0; y < capture.height; ++y) {
+                memcpy(&slot[y*stride], &pixels[(capture.height - 1 - y)*stride], stride);
+            }
+            capture_publish();
+        }
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+
+void capture_gpu(void)
+{
+    if (!capture.active) return;
+
+    if (capture.pbo_frames == 0) {
+        size_t size = (size_t)capture.width*capture.height*4;
+        glGenBuffers(CAPTURE_PBOS, capture.pbos);
+        for (int i = 0; i < CAPTURE_PBOS; ++i) {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, capture.pbos[i]);
+            glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+
+    // The oldest PBO is about to be reused, so collect its frame first
+    GLuint pbo = capture.pbos[capture.pbo_frames % CAPTURE_PBOS];
+    if (capture.pbo_frames >= CAPTURE_PBOS) capture_map_pbo(pbo, !capture.realtime);
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+    glReadPixels(0, 0, capture.width, capture.height, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    capture.pbo_frames += 1;
+}
+
+
+void capture_stop(void)
+{
+    if (!capture.active) return;
+
+    if (capture.pbo_frames > 0) {
+        unsigned int first = capture.pbo_frames > CAPTURE_PBOS ? capture.pbo_frames - CAPTURE_PBOS : 0;
+        for (unsigned int i = first; i < capture.pbo_frames; ++i) {
+            capture_map_pbo(capture.pbos[i % CAPTURE_PBOS], true);
+        }
+        glDeleteBuffers(CAPTURE_PBOS, capture.pbos);
+    }
+
+    atomic_store(&capture.done, true);
+    pthread_join(capture.writer, NULL);
+
+    capture_free();
+    capture.active = false;
+
+    printf("capture: %u frames written, %u dropped\n", capture.written, capture.dropped);
+}
+
+#endif // CAPTURE_IMPLEMENTATION
@@ -0,0 +1,217 @@
+// Heap allocator for the freestanding web build.
+//
+// There is no libc in the wasm build, so there is no malloc either. This one
+// starts at __heap_base, the end of the data and the stack that wasm-ld lays
+// out, and bumps a pointer through linear memory, calling memory.grow when it
+// runs past the end. Freed blocks go to one free list per power of two size
+// class from 16 bytes to 64KiB and are handed out again for the same class.
+// Larger blocks are rounded up to whole pages and kept on a first fit list. Nothing is
+// ever split or merged and memory is never given back, which is fine for
+// buffers that are sized once and maybe grown a few times.
+//
+// Every block is 16 byte aligned, so v128 loads and stores work on it.
+//
+// Growing memory replaces the ArrayBuffer behind it, and views created over
+// the old one see nothing anymore. raylib.js checks its views before every
+// import that touches memory, pointers into the heap stay valid.
+//
+// Natively the heap_* functions are plain malloc and friends. The web
+// allocator isn't thread safe. In the threads build only call it from the
+// main thread, e.g. not from jobs.
+//
+// Define HEAP_IMPLEMENTATION in exactly one file before including this header.
+#ifndef HEAP_H_
+#define HEAP_H_
+
+#include <stddef.h>
+
+void *heap_alloc(size_t size);
+void *heap_calloc(size_t count, size_t size);
+void *heap_realloc(void *ptr, size_t size);     // Moves the block, the contents up to the smaller size are kept
+void heap_free(void *ptr);
+size_t heap_size(void);                         // Bytes of linear memory taken by the heap, 0 natively
+
+#endif // HEAP_H_
+
+#if defined(HEAP_IMPLEMENTATION) && !defined(HEAP_IMPLEMENTATION_DONE_)
+#define HEAP_IMPLEMENTATION_DONE_
+
+#ifdef PLATFORM_WEB
+
+#define HEAP_ALIGN 16
+#define HEAP_MIN_SHIFT 4            // 16 bytes
+#define HEAP_MAX_SHIFT 16           // 64KiB, bigger blocks are whole pages
+#define HEAP_CLASSES (HEAP_MAX_SHIFT - HEAP_MIN_SHIFT + 1)
+#define HEAP_PAGE_SIZE 65536
+
+// Sits right before every block, padded so the block stays aligned
+typedef struct HeapBlock {
+    size_t size;                    // Usable bytes
+    struct HeapBlock *next;         // Next free block, only while on a free list
+    size_t pad[HEAP_ALIGN/sizeof(size_t) - 2];
+} HeapBlock;
+
+extern unsigned char __heap_base;
+
+static struct {
+    size_t top;                     // Next free byte, 0 until the first allocation
+    HeapBlock *free[HEAP_CLASSES];
+    HeapBlock *large;
+} heap = {0};
+
+
+// memset and memcpy have to exist even without a libc, clang emits calls to
+// them for struct copies and zero initialization. With bulk memory they are
+// single memory.fill and memory.copy instructions.
+void *memset(void *dest, int c, size_t n)
+{
+#ifdef __wasm_bulk_memory__
+    __builtin_memset(dest, c, n);
+#else
+    unsigned char *d = dest;
+    while (n--) *d++ = (unsigned char)c;
+#endif
+    return dest;
+}
+
+
+void *memcpy(void *restrict dest, const void *restrict src, size_t n)
+{
+#ifdef __wasm_bulk_memory__
+    __builtin_memcpy(dest, src, n);
+#else
+    unsigned char *d = dest;
+    const unsigned char *s = src;
+    while (n--) *d++ = *s++;
+#endif
+    return dest;
+}
+
+
+void *memmove(void *dest, const void *src, size_t n)
+{
+#ifdef __wasm_bulk_memory__
+    __builtin_memmove(dest, src, n);
+#else
+    unsigned char *d = dest;
+    const unsigned char *s = src;
+    if (d < s) {
+        while (n--) *d++ = *s++;
+    } else {
+        while (n--) d[n] = s[n];
+    }
+#endif
+    return dest;
+}
+
+
+// Smallest class that holds size, HEAP_CLASSES for large blocks
+static int heap_class(size_t size)
+{
+    int shift = HEAP_MIN_SHIFT;
+    while (shift <= HEAP_MAX_SHIFT && ((size_t)1 << shift) < size) shift += 1;
+    return shift - HEAP_MIN_SHIFT;
+}
+
+
+static HeapBlock *heap_bump(size_t size)
+{
+    if (heap.top == 0) heap.top = ((size_t)&__heap_base + HEAP_ALIGN - 1) & ~(size_t)(HEAP_ALIGN - 1);
+
+    size_t end = heap.top + sizeof(HeapBlock) + size;
+    if (end < heap.top) return NULL;
+    size_t memory = __builtin_wasm_memory_size(0)*HEAP_PAGE_SIZE;
+    if (end > memory) {
+        size_t pages = (end - memory + HEAP_PAGE_SIZE - 1)/HEAP_PAGE_SIZE;
+        if (__builtin_wasm_memory_grow(0, pages) == (size_t)-1) return NULL;
+    }
+
+    HeapBlock *block = (HeapBlock *)heap.top;
+    block->size = size;
+    heap.top = end;
+    return block;
+}
+
+
+void *heap_alloc(size_t size)
+{
+    if (size == 0) size = 1;
+    int class = heap_class(size);
+    HeapBlock *block = NULL;
+
+    if (class < HEAP_CLASSES) {
+        size = (size_t)1 << (class + HEAP_MIN_SHIFT);
+        block = heap.free[class];
+        if (block != NULL) heap.free[class] = block->next;
+    } else {
+        // Rounded so header and block take whole pages
+        size = ((size + sizeof(HeapBlock) + HEAP_PAGE_SIZE - 1) & ~(size_t)(HEAP_PAGE_SIZE - 1)) - sizeof(HeapBlock);
+        for (HeapBlock **link = &heap.large; *link != NULL; link = &(*link)->next) {
+            if ((*link)->size >= size) {
+                block = *link;
+                *link = block->next;
+                break;
+            }
+        }
+    }
+
+    if (block == NULL) block = heap_bump(size);
+    if (block == NULL) return NULL;
+    block->next = NULL;
+    return block + 1;
+}
+
+
+void heap_free(void *ptr)
+{
+    if (ptr == NULL) return;
+    HeapBlock *block = (HeapBlock *)ptr - 1;
+    int class = heap_class(block->size);
+    HeapBlock **list = class < HEAP_CLASSES ? &heap.free[class] : &heap.large;
+    block->next = *list;
+    *list = block;
+}
+
+
+void *heap_calloc(size_t count, size_t size)
+{
+    if (size != 0 && count > (size_t)-1/size) return NULL;
+    void *ptr = heap_alloc(count*size);
+    if (ptr != NULL) memset(ptr, 0, count*size);
+    return ptr;
+}
+
+
+void *heap_realloc(void *ptr, size_t size)
+{
+    if (ptr == NULL) return heap_alloc(size);
+    HeapBlock *block = (HeapBlock *)ptr - 1;
+    if (size <= block->size) return ptr;
+
+    void *moved = heap_alloc(size);
+    if (moved == NULL) return NULL;
+    memcpy(moved, ptr, block->size);
+    heap_free(ptr);
+    return moved;
+}
+
+
+size_t heap_size(void)
+{
+    if (heap.top == 0) return 0;
+    return heap.top - (size_t)&__heap_base;
+}
+
+#else
+
+#include <stdlib.h>
+
+void *heap_alloc(size_t size) { return malloc(size); }
+void *heap_calloc(size_t count, size_t size) { return calloc(count, size); }
+void *heap_realloc(void *ptr, size_t size) { return realloc(ptr, size); }
+void heap_free(void *ptr) { free(ptr); }
+size_t heap_size(void) { return 0; }
+
+#endif // PLATFORM_WEB
+
+#endif // HEAP_IMPLEMENTATION
@@ -0,0 +1,269 @@
+// Tiny fork-join job pool.
+//
+// jobs_parallel_for() runs fn(ctx, i) for every i in [0, count) on the worker
+// threads and the calling thread, and returns once all of them are done.
+// The regular web build has no threads, so everything runs on the caller.
+//
+// The threads web build (JOBS_WASM_THREADS, compiled with atomics and shared
+// memory) has no pthreads either: raylib.js starts Web Workers that
+// instantiate the same module on the same memory, point __stack_pointer at
+// the stack from jobs_worker_stack() and call jobs_worker_main(), which never
+// returns. Workers sleep in memory.atomic.wait32 between calls. The caller
+// may be the browser's main thread, which isn't allowed to wait, so it spins
+// until the last job is done. A worker can still be leaving the previous call
+// when the next one starts, so the next index carries the generation it
+// belongs to and a worker only claims one while it matches its own.
+//
+// Define JOBS_IMPLEMENTATION in exactly one file before including this header.
+#ifndef JOBS_H_
+#define JOBS_H_
+
+#define JOBS_MAX_THREADS 64
+
+typedef void (*JobFn)(void *ctx, int index);
+
+void jobs_init(int threads);    // Number of threads including the caller, 0 means one per CPU
+void jobs_shutdown(void);
+int jobs_thread_count(void);    // Threads that take part in jobs_parallel_for(), including the caller
+void jobs_parallel_for(int count, JobFn fn, void *ctx);
+
+#endif // JOBS_H_
+
+#if defined(JOBS_IMPLEMENTATION) && !defined(JOBS_IMPLEMENTATION_DONE_)
+#define JOBS_IMPLEMENTATION_DONE_
+
+#if defined(PLATFORM_WEB) && defined(JOBS_WASM_THREADS)
+
+#include <stdatomic.h>
+
+#define JOBS_WASM_WORKERS 8
+#define JOBS_WASM_STACK_SIZE (64*1024)
+
+static struct {
+    atomic_int workers;         // Workers that entered jobs_worker_main()
+    atomic_uint generation;     // Bumped for every jobs_parallel_for() call, workers wait on it
+    atomic_ullong next;         // Generation in the high 32 bits, next index in the low ones
+    atomic_ullong total;        // Generation in the high 32 bits, count in the low ones
+    atomic_int done;
+
+    // Only read after claiming an index that is still to be done, the caller
+    // doesn't touch them before that job is finished
+    JobFn fn;
+    void *ctx;
+} jobs = {0};
+
+static _Alignas(16) unsigned char jobs_stacks[JOBS_WASM_WORKERS][JOBS_WASM_STACK_SIZE];
+
+
+static void jobs_run(unsigned int generation)
+{
+    for (;;) {
+        // Only take an index while next still belongs to this call. A worker
+        // that is late for it must not use up an index of the next one, the
+        // caller would then wait forever for that job. Acquire pairs with the
+        // release in jobs_parallel_for(), so fn, ctx and total are current.
+        unsigned long long claim = atomic_load_explicit(&jobs.next, memory_order_acquire);
+        do {
+            if ((unsigned int)(claim >> 32) != generation) return;
+        } while (!atomic_compare_exchange_weak_explicit(&jobs.next, &claim, claim + 1, memory_order_acquire, memory_order_acquire));
+
+        // A newer total means this call is over, and so the index was out of range for it
+        unsigned long long total = atomic_load_explicit(&jobs.total, memory_order_relaxed);
+        if ((unsigned int)(total >> 32) != generation) break;
+        unsigned int i = (unsigned int)claim;
+        if (i >= (unsigned int)total) break;
+        jobs.fn(jobs.ctx, (int)i);
+        atomic_fetch_add_explicit(&jobs.done, 1, memory_order_release);
+    }
+}
+
+
+// Top of the stack for the worker with the given index, 0 when there are enough workers.
+// raylib.js calls it on the main thread, a worker can't run C code before its stack is set.
+void *jobs_worker_stack(int index)
+{
+    if (index < 0 || index >= JOBS_WASM_WORKERS) return 0;
+    return jobs_stacks[index] + JOBS_WASM_STACK_SIZE;
+}
+
+
+void jobs_worker_main(void)
+{
+    unsigned int seen = atomic_load(&jobs.generation);
+    atomic_fetch_add(&jobs.workers, 1);
+    for (;;) {
+        __builtin_wasm_memory_atomic_wait32((int *)&jobs.generation, (int)seen, -1);
+        unsigned int generation = atomic_load(&jobs.generation);
+        if (generation == seen) continue;
+        seen = generation;
+        jobs_run(generation);
+    }
+}
+
+
+void jobs_init(int threads) { (void) threads; }
+void jobs_shutdown(void) {}
+
+int jobs_thread_count(void)
+{
+    return atomic_load(&jobs.workers) + 1;
+}
+
+
+void jobs_parallel_for(int count, JobFn fn, void *ctx)
+{
+    if (count <= 0) return;
+    if (atomic_load(&jobs.workers) == 0 || count == 1) {
+        for (int i = 0; i < count; ++i) fn(ctx, i);
+        return;
+    }
+
+    // Claims of the previous generation fail from here on, and nobody runs
+    // one of its jobs anymore since they were all done before it returned
+    unsigned int generation = atomic_load(&jobs.generation) + 1;
+    jobs.fn = fn;
+    jobs.ctx = ctx;
+    atomic_store_explicit(&jobs.total, (unsigned long long)generation << 32 | (unsigned int)count, memory_order_relaxed);
+    atomic_store_explicit(&jobs.done, 0, memory_order_relaxed);
+    atomic_store_explicit(&jobs.next, (unsigned long long)generation << 32, memory_order_release);
+    atomic_store(&jobs.generation, generation);
+    __builtin_wasm_memory_atomic_notify((int *)&jobs.generation, JOBS_WASM_WORKERS);
+
+    jobs_run(generation);
+
+    while (atomic_load_explicit(&jobs.done, memory_order_acquire) < count) {}
+}
+
+#elif defined(PLATFORM_WEB)
+
+void jobs_init(int threads) { (void) threads; }
+void jobs_shutdown(void) {}
+int jobs_thread_count(void) { return 1; }
+
+void jobs_parallel_for(int count, JobFn fn, void *ctx)
+{
+    for (int i = 0; i < count; ++i) fn(ctx, i);
+}
+
+#else
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <unistd.h>
+
+static struct {
+    pthread_t threads[JOBS_MAX_THREADS];
+    int count;                  // Worker threads, the caller is not counted
+    pthread_mutex_t mutex;
+    pthread_cond_t wake;
+    pthread_cond_t done;
+    unsigned int generation;    // Bumped for every jobs_parallel_for() call
+    int active;                 // Workers that haven't finished the current generation
+    bool quit;
+
+    JobFn fn;
+    void *ctx;
+    int total;
+    atomic_int next;
+} jobs = {
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+    .wake = PTHREAD_COND_INITIALIZER,
+    .done = PTHREAD_COND_INITIALIZER,
+};
+
+
+static void jobs_run(void)
+{
+    for (;;) {
+        int i = atomic_fetch_add(&jobs.next, 1);
+        if (i >= jobs.total) break;
+        jobs.fn(jobs.ctx, i);
+    }
+}
+
+
+static void *jobs_worker(void *arg)
+{
+    (void) arg;
+    unsigned int seen = 0;
+    pthread_mutex_lock(&jobs.mutex);
+    for (;;) {
+        while (!jobs.quit && jobs.generation == seen) {
+            pthread_cond_wait(&jobs.wake, &jobs.mutex);
+        }
+        if (jobs.quit) break;
+        seen = jobs.generation;
+        pthread_mutex_unlock(&jobs.mutex);
+
+        jobs_run();
+
+        pthread_mutex_lock(&jobs.mutex);
+        jobs.active -= 1;
+        if (jobs.active == 0) pthread_cond_signal(&jobs.done);
+    }
+    pthread_mutex_unlock(&jobs.mutex);
+    return NULL;
+}
+
+
+void jobs_init(int threads)
+{
+    if (threads <= 0) threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads > JOBS_MAX_THREADS) threads = JOBS_MAX_THREADS;
+
+    jobs.quit = false;
+    jobs.count = 0;
+    for (int i = 0; i < threads - 1; ++i) {
+        if (pthread_create(&jobs.threads[jobs.count], NULL, jobs_worker, NULL) != 0) break;
+        jobs.count += 1;
+    }
+}
+
+
+void jobs_shutdown(void)
+{
+    pthread_mutex_lock(&jobs.mutex);
+    jobs.quit = true;
+    pthread_cond_broadcast(&jobs.wake);
+    pthread_mutex_unlock(&jobs.mutex);
+
+    for (int i = 0; i < jobs.count; ++i) pthread_join(jobs.threads[i], NULL);
+    jobs.count = 0;
+}
+
+
+int jobs_thread_count(void)
+{
+    return jobs.count + 1;
+}
+
+
+void jobs_parallel_for(int count, JobFn fn, void *ctx)
+{
+    if (count <= 0) return;
+    if (jobs.count == 0 || count == 1) {
+        for (int i = 0; i < count; ++i) fn(ctx, i);
+        return;
+    }
+
+    pthread_mutex_lock(&jobs.mutex);
+    jobs.fn = fn;
+    jobs.ctx = ctx;
+    jobs.total = count;
+    atomic_store(&jobs.next, 0);
+    jobs.active = jobs.count;
+    jobs.generation += 1;
+    pthread_cond_broadcast(&jobs.wake);
+    pthread_mutex_unlock(&jobs.mutex);
+
+    jobs_run();
+
+    pthread_mutex_lock(&jobs.mutex);
+    while (jobs.active > 0) pthread_cond_wait(&jobs.done, &jobs.mutex);
+    pthread_mutex_unlock(&jobs.mutex);
+}
+
+#endif // PLATFORM_WEB && JOBS_WASM_THREADS
+
+#endif // JOBS_IMPLEMENTATION
@@ -0,0 +1,637 @@
+// Software rasterizer for the primitives balls.c draws: filled circles,
+// gradient circles, rectangles and text in a built-in 5x7 bitmap font.
+// Pixels are RGBA8 in a linear framebuffer, the same layout as raylib's Color,
+// so a frame can be written to disk or blitted to a canvas as is.
+//
+// Draw calls are only recorded. swr_end() bins them into tiles and rasterizes
+// the tiles in parallel with jobs.h, processing spans four pixels at a time
+// with SSE2 or wasm SIMD128 when the target has them.
+//
+// The framebuffer, the command list and the tile bins come from heap.h and
+// are sized by the largest frame so far, memory for SWR_MAX_WIDTH x
+// SWR_MAX_HEIGHT is only taken when a frame is that big. The framebuffer is
+// cleared to transparent black whenever the size changes.
+//
+// Define SWRAST_IMPLEMENTATION in exactly one file before including this header.
+#ifndef SWRAST_H_
+#define SWRAST_H_
+
+#include "raylib.h"
+
+#ifndef SWR_MAX_WIDTH
+#define SWR_MAX_WIDTH 3840
+#endif
+#ifndef SWR_MAX_HEIGHT
+#define SWR_MAX_HEIGHT 2160
+#endif
+#define SWR_INITIAL_COMMANDS (1 << 10)
+#define SWR_INITIAL_BINNED (1 << 14)
+#define SWR_TILE_SIZE 64
+
+void swr_begin(int width, int height);      // Start a frame, the size is clamped to SWR_MAX_WIDTH x SWR_MAX_HEIGHT
+void swr_clear(Color color);
+void swr_circle(Vector2 center, float radius, Color color);
+void swr_circle_gradient(Vector2 center, float radius, Color inner, Color outer);
+void swr_rectangle(int x, int y, int width, int height, Color color);
+void swr_text(const char *text, int x, int y, int font_size, Color color);
+void swr_end(void);                         // Rasterize everything recorded since swr_begin()
+
+unsigned char *swr_pixels(void);            // RGBA8, swr_width()*4 bytes per row
+int swr_width(void);
+int swr_height(void);
+
+#endif // SWRAST_H_
+
+#ifdef SWRAST_IMPLEMENTATION
+
+#include <stddef.h>
+
+#include "heap.h"
+#include "jobs.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__wasm_simd128__)
+#include <wasm_simd128.h>
+#endif
+
+// Four pixel lanes
+// ------------------------------------------------------------
+#if defined(__SSE2__)
+
+typedef __m128 swr_f4;
+typedef __m128i swr_u4;
+
+static inline swr_f4 swr_f4_set(float x) { return _mm_set1_ps(x); }
+static inline swr_f4 swr_f4_make(float a, float b, float c, float d) { return _mm_setr_ps(a, b, c, d); }
+static inline swr_f4 swr_f4_add(swr_f4 a, swr_f4 b) { return _mm_add_ps(a, b); }
+static inline swr_f4 swr_f4_sub(swr_f4 a, swr_f4 b) { return _mm_sub_ps(a, b); }
+static inline swr_f4 swr_f4_mul(swr_f4 a, swr_f4 b) { return _mm_mul_ps(a, b); }
+static inline swr_f4 swr_f4_min(swr_f4 a, swr_f4 b) { return _mm_min_ps(a, b); }
+static inline swr_f4 swr_f4_max(swr_f4 a, swr_f4 b) { return _mm_max_ps(a, b); }
+static inline swr_f4 swr_f4_sqrt(swr_f4 a) { return _mm_sqrt_ps(a); }
+static inline swr_u4 swr_u4_load(const unsigned int *p) { return _mm_loadu_si128((const __m128i *)p); }
+static inline void swr_u4_store(unsigned int *p, swr_u4 v) { _mm_storeu_si128((__m128i *)p, v); }
+
+static inline swr_f4 swr_channel(swr_u4 p, int shift)
+{
+    return _mm_cvtepi32_ps(_mm_and_si128(_mm_srl_epi32(p, _mm_cvtsi32_si128(shift)), _mm_set1_epi32(0xFF)));
+}
+
+static inline swr_u4 swr_pack(swr_f4 r, swr_f4 g, swr_f4 b, swr_f4 a)
+{
+    swr_f4 half = _mm_set1_ps(0.5f);
+    swr_u4 ri = _mm_cvttps_epi32(_mm_add_ps(r, half));
+    swr_u4 gi = _mm_cvttps_epi32(_mm_add_ps(g, half));
+    swr_u4 bi = _mm_cvttps_epi32(_mm_add_ps(b, half));
+    swr_u4 ai = _mm_cvttps_epi32(_mm_add_ps(a, half));
+    return _mm_or_si128(_mm_or_si128(ri, _mm_slli_epi32(gi, 8)), _mm_or_si128(_mm_slli_epi32(bi, 16), _mm_slli_epi32(ai, 24)));
+}
+
+#elif defined(__wasm_simd128__)
+
+typedef v128_t swr_f4;
+typedef v128_t swr_u4;
+
+static inline swr_f4 swr_f4_set(float x) { return wasm_f32x4_splat(x); }
+static inline swr_f4 swr_f4_make(float a, float b, float c, float d) { return wasm_f32x4_make(a, b, c, d); }
+static inline swr_f4 swr_f4_add(swr_f4 a, swr_f4 b) { return wasm_f32x4_add(a, b); }
+static inline swr_f4 swr_f4_sub(swr_f4 a, swr_f4 b) { return wasm_f32x4_sub(a, b); }
+static inline swr_f4 swr_f4_mul(swr_f4 a, swr_f4 b) { return wasm_f32x4_mul(a, b); }
+static inline swr_f4 swr_f4_min(swr_f4 a, swr_f4 b) { return wasm_f32x4_pmin(a, b); }
+static inline swr_f4 swr_f4_max(swr_f4 a, swr_f4 b) { return wasm_f32x4_pmax(a, b); }
+static inline swr_f4 swr_f4_sqrt(swr_f4 a) { return wasm_f32x4_sqrt(a); }
+static inline swr_u4 swr_u4_load(const unsigned int *p) { return wasm_v128_load(p); }
+static inline void swr_u4_store(unsigned int *p, swr_u4 v) { wasm_v128_store(p, v); }
+
+static inline swr_f4 swr_channel(swr_u4 p, int shift)
+{
+    return wasm_f32x4_convert_i32x4(wasm_v128_and(wasm_u32x4_shr(p, shift), wasm_i32x4_splat(0xFF)));
+}
+
+static inline swr_u4 swr_pack(swr_f4 r, swr_f4 g, swr_f4 b, swr_f4 a)
+{
+    swr_f4 half = wasm_f32x4_splat(0.5f);
+    swr_u4 ri = wasm_i32x4_trunc_sat_f32x4(wasm_f32x4_add(r, half));
+    swr_u4 gi = wasm_i32x4_trunc_sat_f32x4(wasm_f32x4_add(g, half));
+    swr_u4 bi = wasm_i32x4_trunc_sat_f32x4(wasm_f32x4_add(b, half));
+    swr_u4 ai = wasm_i32x4_trunc_sat_f32x4(wasm_f32x4_add(a, half));
+    return wasm_v128_or(wasm_v128_or(ri, wasm_i32x4_shl(gi, 8)), wasm_v128_or(wasm_i32x4_shl(bi, 16), wasm_i32x4_shl(ai, 24)));
+}
+
+#else
+
+typedef struct { float v[4]; } swr_f4;
+typedef struct { unsigned int v[4]; } swr_u4;
+
+#define SWR_LANES(expr) do { for (int i = 0; i < 4; ++i) { expr; } } while (0)
+
+static inline swr_f4 swr_f4_set(float x) { swr_f4 r; SWR_LANES(r.v[i] = x); return r; }
+static inline swr_f4 swr_f4_make(float a, float b, float c, float d) { swr_f4 r = {{a, b, c, d}}; return r; }
+static inline swr_f4 swr_f4_add(swr_f4 a, swr_f4 b) { swr_f4 r; SWR_LANES(r.v[i] = a.v[i] + b.v[i]); return r; }
+static inline swr_f4 swr_f4_sub(swr_f4 a, swr_f4 b) { swr_f4 r; SWR_LANES(r.v[i] = a.v[i] - b.v[i]); return r; }
+static inline swr_f4 swr_f4_mul(swr_f4 a, swr_f4 b) { swr_f4 r; SWR_LANES(r.v[i] = a.v[i]*b.v[i]); return r; }
+static inline swr_f4 swr_f4_min(swr_f4 a, swr_f4 b) { swr_f4 r; SWR_LANES(r.v[i] = b.v[i] < a.v[i] ? b.v[i] : a.v[i]); return r; }
+static inline swr_f4 swr_f4_max(swr_f4 a, swr_f4 b) { swr_f4 r; SWR_LANES(r.v[i] = a.v[i] < b.v[i] ? b.v[i] : a.v[i]); return r; }
+static inline swr_f4 swr_f4_sqrt(swr_f4 a) { swr_f4 r; SWR_LANES(r.v[i] = __builtin_sqrtf(a.v[i])); return r; }
+static inline swr_u4 swr_u4_load(const unsigned int *p) { swr_u4 r; SWR_LANES(r.v[i] = p[i]); return r; }
+static inline void swr_u4_store(unsigned int *p, swr_u4 v) { SWR_LANES(p[i] = v.v[i]); }
+
+static inline swr_f4 swr_channel(swr_u4 p, int shift)
+{
+    swr_f4 r;
+    SWR_LANES(r.v[i] = (float)((p.v[i] >> shift) & 0xFF));
+    return r;
+}
+
+static inline swr_u4 swr_pack(swr_f4 r, swr_f4 g, swr_f4 b, swr_f4 a)
+{
+    swr_u4 p;
+    SWR_LANES(p.v[i] = (unsigned int)(r.v[i] + 0.5f) | (unsigned int)(g.v[i] + 0.5f) << 8 |
+                       (unsigned int)(b.v[i] + 0.5f) << 16 | (unsigned int)(a.v[i] + 0.5f) << 24);
+    return p;
+}
+
+#endif
+// ------------------------------------------------------------
+
+typedef enum {
+    SWR_CLEAR = 0,
+    SWR_CIRCLE,
+    SWR_RECTANGLE,
+} SwrCommandType;
+
+typedef struct {
+    SwrCommandType type;
+    int x0, y0, x1, y1;     // Pixel bounds clipped to the framebuffer, x1 and y1 are exclusive
+    float cx, cy, radius;
+    Color inner, outer;     // Rectangles and clears only use inner
+} SwrCommand;
+
+static struct {
+    int width, height;
+    int tiles_x, tiles_y;
+    unsigned int *pixels;
+    size_t pixels_capacity;
+
+    SwrCommand *commands;
+    int command_count;
+    int commands_capacity;
+
+    // Commands touching each tile, in submission order: tile i owns
+    // binned[tile_start[i] .. tile_start[i + 1]). When the bins can't grow
+    // for a frame every tile walks the whole command list instead.
+    int *tile_start;        // tiles + 1 entries
+    int *tile_fill;         // tiles entries, allocated with tile_start
+    int tiles_capacity;
+    int *binned;
+    int binned_capacity;
+    bool overflow;
+} swr = {0};
+
+// 5x7 glyphs for ASCII 32..126, one byte per column, least significant bit on top
+static const unsigned char swr_font[95*5] = {
+    0x00, 0x00, 0x00, 0x00, 0x00,  // space
+    0x00, 0x00, 0x5F, 0x00, 0x00,  // !
+    0x00, 0x07, 0x00, 0x07, 0x00,  // "
+    0x14, 0x7F, 0x14, 0x7F, 0x14,  // #
+    0x24, 0x2A, 0x7F, 0x2A, 0x12,  // $
+    0x23, 0x13, 0x08, 0x64, 0x62,  // %
+    0x36, 0x49, 0x55, 0x22, 0x50,  // &
+    0x00, 0x05, 0x03, 0x00, 0x00,  // '
+    0x00, 0x1C, 0x22, 0x41, 0x00,  // (
+    0x00, 0x41, 0x22, 0x1C, 0x00,  // )
+    0x14, 0x08, 0x3E, 0x08, 0x14,  // *
+    0x08, 0x08, 0x3E, 0x08, 0x08,  // +
+    0x00, 0x50, 0x30, 0x00, 0x00,  // ,
+    0x08, 0x08, 0x08, 0x08, 0x08,  // -
+    0x00, 0x60, 0x60, 0x00, 0x00,  // .
+    0x20, 0x10, 0x08, 0x04, 0x02,  // /
+    0x3E, 0x51, 0x49, 0x45, 0x3E,  // 0
+    0x00, 0x42, 0x7F, 0x40, 0x00,  // 1
+    0x42, 0x61, 0x51, 0x49, 0x46,  // 2
+    0x21, 0x41, 0x45, 0x4B, 0x31,  // 3
+    0x18, 0x14, 0x12, 0x7F, 0x10,  // 4
+    0x27, 0x45, 0x45, 0x45, 0x39,  // 5
+    0x3C, 0x4A, 0x49, 0x49, 0x30,  // 6
+    0x01, 0x71, 0x09, 0x05, 0x03,  // 7
+    0x36, 0x49, 0x49, 0x49, 0x36,  // 8
+    0x06, 0x49, 0x49, 0x29, 0x1E,  // 9
+    0x00, 0x36, 0x36, 0x00, 0x00,  // :
+    0x00, 0x56, 0x36, 0x00, 0x00,  // ;
+    0x08, 0x14, 0x22, 0x41, 0x00,  // <
+    0x14, 0x14, 0x14, 0x14, 0x14,  // =
+    0x00, 0x41, 0x22, 0x14, 0x08,  // >
+    0x02, 0x01, 0x51, 0x09, 0x06,  // ?
+    0x32, 0x49, 0x79, 0x41, 0x3E,  // @
+    0x7E, 0x11, 0x11, 0x11, 0x7E,  // A
+    0x7F, 0x49, 0x49, 0x49, 0x36,  // B
+    0x3E, 0x41, 0x41, 0x41, 0x22,  // C
+    0x7F, 0x41, 0x41, 0x22, 0x1C,  // D
+    0x7F, 0x49, 0x49, 0x49, 0x41,  // E
+    0x7F, 0x09, 0x09, 0x09, 0x01,  // F
+    0x3E, 0x41, 0x49, 0x49, 0x7A,  // G
+    0x7F, 0x08, 0x08, 0x08, 0x7F,  // H
+    0x00, 0x41, 0x7F, 0x41, 0x00,  // I
+    0x20, 0x40, 0x41, 0x3F, 0x01,  // J
+    0x7F, 0x08, 0x14, 0x22, 0x41,  // K
+    0x7F, 0x40, 0x40, 0x40, 0x40,  // L
+    0x7F, 0x02, 0x0C, 0x02, 0x7F,  // M
+    0x7F, 0x04, 0x08, 0x10, 0x7F,  // N
+    0x3E, 0x41, 0x41, 0x41, 0x3E,  // O
+    0x7F, 0x09, 0x09, 0x09, 0x06,  // P
+    0x3E, 0x41, 0x51, 0x21, 0x5E,  // Q
+    0x7F, 0x09, 0x19, 0x29, 0x46,  // R
+    0x46, 0x49, 0x49, 0x49, 0x31,  // S
+    0x01, 0x01, 0x7F, 0x01, 0x01,  // T
+    0x3F, 0x40, 0x40, 0x40, 0x3F,  // U
+    0x1F, 0x20, 0x40, 0x20, 0x1F,  // V
+    0x3F, 0x40, 0x38, 0x40, 0x3F,  // W
+    0x63, 0x14, 0x08, 0x14, 0x63,  // X
+    0x07, 0x08, 0x70, 0x08, 0x07,  // Y
+    0x61, 0x51, 0x49, 0x45, 0x43,  // Z
+    0x00, 0x7F, 0x41, 0x41, 0x00,  // [
+    0x02, 0x04, 0x08, 0x10, 0x20,  // backslash
+    0x00, 0x41, 0x41, 0x7F, 0x00,  // ]
+    0x04, 0x02, 0x01, 0x02, 0x04,  // ^
+    0x40, 0x40, 0x40, 0x40, 0x40,  // _
+    0x00, 0x01, 0x02, 0x04, 0x00,  // `
+    0x20, 0x54, 0x54, 0x54, 0x78,  // a
+    0x7F, 0x48, 0x44, 0x44, 0x38,  // b
+    0x38, 0x44, 0x44, 0x44, 0x20,  // c
+    0x38, 0x44, 0x44, 0x48, 0x7F,  // d
+    0x38, 0x54, 0x54, 0x54, 0x18,  // e
+    0x08, 0x7E, 0x09, 0x01, 0x02,  // f
+    0x0C, 0x52, 0x52, 0x52, 0x3E,  // g
+    0x7F, 0x08, 0x04, 0x04, 0x78,  // h
+    0x00, 0x44, 0x7D, 0x40, 0x00,  // i
+    0x20, 0x40, 0x44, 0x3D, 0x00,  // j
+    0x7F, 0x10, 0x28, 0x44, 0x00,  // k
+    0x00, 0x41, 0x7F, 0x40, 0x00,  // l
+    0x7C, 0x04, 0x18, 0x04, 0x78,  // m
+    0x7C, 0x08, 0x04, 0x04, 0x78,  // n
+    0x38, 0x44, 0x44, 0x44, 0x38,  // o
+    0x7C, 0x14, 0x14, 0x14, 0x08,  // p
+    0x08, 0x14, 0x14, 0x18, 0x7C,  // q
+    0x7C, 0x08, 0x04, 0x04, 0x08,  // r
+    0x48, 0x54, 0x54, 0x54, 0x20,  // s
+    0x04, 0x3F, 0x44, 0x40, 0x20,  // t
+    0x3C, 0x40, 0x40, 0x20, 0x7C,  // u
+    0x1C, 0x20, 0x40, 0x20, 0x1C,  // v
+    0x3C, 0x40, 0x30, 0x40, 0x3C,  // w
+    0x44, 0x28, 0x10, 0x28, 0x44,  // x
+    0x0C, 0x50, 0x50, 0x50, 0x3C,  // y
+    0x44, 0x64, 0x54, 0x4C, 0x44,  // z
+    0x00, 0x08, 0x36, 0x41, 0x00,  // {
+    0x00, 0x00, 0x7F, 0x00, 0x00,  // |
+    0x00, 0x41, 0x36, 0x08, 0x00,  // }
+    0x08, 0x04, 0x08, 0x10, 0x08,  // ~
+};
+
+
+static inline int swr_clampi(int x, int lo, int hi)
+{
+    return x < lo ? lo : x > hi ? hi : x;
+}
+
+
+static void swr_push(SwrCommand command)
+{
+    command.x0 = swr_clampi(command.x0, 0, swr.width);
+    command.x1 = swr_clampi(command.x1, 0, swr.width);
+    command.y0 = swr_clampi(command.y0, 0, swr.height);
+    command.y1 = swr_clampi(command.y1, 0, swr.height);
+    if (command.x0 >= command.x1 || command.y0 >= command.y1) return;
+    if (swr.command_count >= swr.commands_capacity) {
+        // Only dropped when memory runs out
+        int capacity = swr.commands_capacity > 0 ? 2*swr.commands_capacity : SWR_INITIAL_COMMANDS;
+        SwrCommand *commands = heap_realloc(swr.commands, (size_t)capacity*sizeof(*commands));
+        if (commands == NULL) return;
+        swr.commands = commands;
+        swr.commands_capacity = capacity;
+    }
+    swr.commands[swr.command_count++] = command;
+}
+
+
+// Buffers only ever grow, the old contents are dropped since the layout changes anyway.
+// When memory runs out the frame is empty.
+static bool swr_reserve(int width, int height, int tiles)
+{
+    size_t pixels = (size_t)width*height;
+    if (pixels > swr.pixels_capacity) {
+        heap_free(swr.pixels);
+        swr.pixels = heap_alloc(pixels*sizeof(*swr.pixels));
+        swr.pixels_capacity = swr.pixels != NULL ? pixels : 0;
+        if (swr.pixels == NULL) return false;
+    }
+    if (tiles > swr.tiles_capacity) {
+        heap_free(swr.tile_start);
+        swr.tile_start = heap_alloc((2*(size_t)tiles + 1)*sizeof(*swr.tile_start));
+        swr.tile_fill = swr.tile_start != NULL ? swr.tile_start + tiles + 1 : NULL;
+        swr.tiles_capacity = swr.tile_start != NULL ? tiles : 0;
+        if (swr.tile_start == NULL) return false;
+    }
+    return true;
+}
+
+
+void swr_begin(int width, int height)
+{
+    width = swr_clampi(width, 0, SWR_MAX_WIDTH);
+    height = swr_clampi(height, 0, SWR_MAX_HEIGHT);
+    int tiles_x = (width + SWR_TILE_SIZE - 1)/SWR_TILE_SIZE;
+    int tiles_y = (height + SWR_TILE_SIZE - 1)/SWR_TILE_SIZE;
+    if (!swr_reserve(width, height, tiles_x*tiles_y)) width = height = tiles_x = tiles_y = 0;
+
+    // The rows of the old frame don't line up anymore, and fresh memory holds
+    // whatever was there before, so a frame that doesn't clear would show it
+    if (swr.pixels != NULL && (width != swr.width || height != swr.height)) {
+        __builtin_memset(swr.pixels, 0, (size_t)width*height*sizeof(*swr.pixels));
+    }
+    swr.width = width;
+    swr.height = height;
+    swr.tiles_x = tiles_x;
+    swr.tiles_y = tiles_y;
+    swr.command_count = 0;
+}
+
+
+void swr_clear(Color color)
+{
+    SwrCommand command = { .type = SWR_CLEAR, .x1 = swr.width, .y1 = swr.height, .inner = color };
+    swr_push(command);
+}
+
+
+void swr_circle_gradient(Vector2 center, float radius, Color inner, Color outer)
+{
+    if (radius <= 0.0f) return;
+    SwrCommand command = {
+        .type = SWR_CIRCLE,
+        .x0 = (int)__builtin_floorf(center.x - radius - 1.0f),
+        .y0 = (int)__builtin_floorf(center.y - radius - 1.0f),
+        .x1 = (int)__builtin_ceilf(center.x + radius + 1.0f),
+        .y1 = (int)__builtin_ceilf(center.y + radius + 1.0f),
+        .cx = center.x,
+        .cy = center.y,
+        .radius = radius,
+        .inner = inner,
+        .outer = outer,
+    };
+    swr_push(command);
+}
+
+
+void swr_circle(Vector2 center, float radius, Color color)
+{
+    swr_circle_gradient(center, radius, color, color);
+}
+
+
+void swr_rectangle(int x, int y, int width, int height, Color color)
+{
+    SwrCommand command = {
+        .type = SWR_RECTANGLE,
+        .x0 = x,
+        .y0 = y,
+        .x1 = x + width,
+        .y1 = y + height,
+        .inner = color,
+    };
+    swr_push(command);
+}
+
+
+// Same metrics as raylib's default font: 10 pixels base size, one unit of spacing
+void swr_text(const char *text, int x, int y, int font_size, Color color)
+{
+    int scale = font_size < 10 ? 1 : font_size/10;
+    int pen_x = x;
+    for (; *text != '\0'; ++text) {
+        unsigned char c = (unsigned char)*text;
+        if (c == '\n') {
+            pen_x = x;
+            y += font_size + 2*scale;
+            continue;
+        }
+        if (c < 32 || c > 126) c = '?';
+        const unsigned char *glyph = &swr_font[(c - 32)*5];
+        for (int col = 0; col < 5; ++col) {
+            // One rectangle per vertical run of set bits
+            unsigned char bits = glyph[col];
+            int row = 0;
+            while (row < 7) {
+                if (!(bits & (1 << row))) { row += 1; continue; }
+                int start = row;
+                while (row < 7 && (bits & (1 << row))) row += 1;
+                swr_rectangle(pen_x + col*scale, y + start*scale, scale, (row - start)*scale, color);
+            }
+        }
+        pen_x += 6*scale;
+    }
+}
+
+
+static void swr_fill_span(unsigned int *row, int x0, int x1, Color color)
+{
+    unsigned int packed = (unsigned int)color.r | (unsigned int)color.g << 8 | (unsigned int)color.b << 16 | (unsigned int)color.a << 24;
+    for (int x = x0; x < x1; ++x) row[x] = packed;
+}
+
+
+// Blend four pixels: src colors are 0..255, coverage is 0..1
+static inline swr_u4 swr_blend(swr_u4 dst, swr_f4 r, swr_f4 g, swr_f4 b, swr_f4 a, swr_f4 coverage)
+{
+    swr_f4 k = swr_f4_mul(swr_f4_mul(a, swr_f4_set(1.0f/255.0f)), coverage);
+    swr_f4 dr = swr_channel(dst, 0);
+    swr_f4 dg = swr_channel(dst, 8);
+    swr_f4 db = swr_channel(dst, 16);
+    swr_f4 da = swr_channel(dst, 24);
+    dr = swr_f4_add(dr, swr_f4_mul(swr_f4_sub(r, dr), k));
+    dg = swr_f4_add(dg, swr_f4_mul(swr_f4_sub(g, dg), k));
+    db = swr_f4_add(db, swr_f4_mul(swr_f4_sub(b, db), k));
+    da = swr_f4_add(da, swr_f4_mul(swr_f4_sub(swr_f4_set(255.0f), da), k));
+    return swr_pack(dr, dg, db, da);
+}
+
+
+static void swr_blend_span(unsigned int *row, int x0, int x1, Color color)
+{
+    swr_f4 r = swr_f4_set(color.r);
+    swr_f4 g = swr_f4_set(color.g);
+    swr_f4 b = swr_f4_set(color.b);
+    swr_f4 a = swr_f4_set(color.a);
+    swr_f4 one = swr_f4_set(1.0f);
+
+    int x = x0;
+    for (; x + 4 <= x1; x += 4) {
+        swr_u4_store(&row[x], swr_blend(swr_u4_load(&row[x]), r, g, b, a, one));
+    }
+    if (x < x1) {
+        unsigned int tail[4] = {0};
+        for (int i = 0; i < x1 - x; ++i) tail[i] = row[x + i];
+        swr_u4_store(tail, swr_blend(swr_u4_load(tail), r, g, b, a, one));
+        for (int i = 0; i < x1 - x; ++i) row[x + i] = tail[i];
+    }
+}
+
+
+static inline swr_u4 swr_circle_lanes(const SwrCommand *c, swr_u4 dst, float x, float dy2)
+{
+    swr_f4 dx = swr_f4_sub(swr_f4_make(x + 0.5f, x + 1.5f, x + 2.5f, x + 3.5f), swr_f4_set(c->cx));
+    swr_f4 d = swr_f4_sqrt(swr_f4_add(swr_f4_mul(dx, dx), swr_f4_set(dy2)));
+
+    // Coverage ramps over one pixel around the edge, the gradient runs from the center to the edge
+    swr_f4 coverage = swr_f4_min(swr_f4_max(swr_f4_sub(swr_f4_set(c->radius + 0.5f), d), swr_f4_set(0.0f)), swr_f4_set(1.0f));
+    swr_f4 t = swr_f4_min(swr_f4_mul(d, swr_f4_set(1.0f/c->radius)), swr_f4_set(1.0f));
+
+    swr_f4 r = swr_f4_add(swr_f4_set(c->inner.r), swr_f4_mul(swr_f4_set((float)c->outer.r - c->inner.r), t));
+    swr_f4 g = swr_f4_add(swr_f4_set(c->inner.g), swr_f4_mul(swr_f4_set((float)c->outer.g - c->inner.g), t));
+    swr_f4 b = swr_f4_add(swr_f4_set(c->inner.b), swr_f4_mul(swr_f4_set((float)c->outer.b - c->inner.b), t));
+    swr_f4 a = swr_f4_add(swr_f4_set(c->inner.a), swr_f4_mul(swr_f4_set((float)c->outer.a - c->inner.a), t));
+    return swr_blend(dst, r, g, b, a, coverage);
+}
+
+
+static void swr_circle_rows(const SwrCommand *c, int x0, int y0, int x1, int y1)
+{
+    float outer = c->radius + 0.5f;
+    for (int y = y0; y < y1; ++y) {
+        float dy = (float)y + 0.5f - c->cy;
+        float dy2 = dy*dy;
+        if (dy2 >= outer*outer) continue;
+
+        // Only walk the pixels the circle can touch on this row
+        float half = __builtin_sqrtf(outer*outer - dy2);
+        int sx0 = swr_clampi((int)__builtin_floorf(c->cx - half), x0, x1);
+        int sx1 = swr_clampi((int)__builtin_ceilf(c->cx + half), x0, x1);
+
+        unsigned int *row = &swr.pixels[y*swr.width];
+        int x = sx0;
+        for (; x + 4 <= sx1; x += 4) {
+            swr_u4_store(&row[x], swr_circle_lanes(c, swr_u4_load(&row[x]), (float)x, dy2));
+        }
+        if (x < sx1) {
+            unsigned int tail[4] = {0};
+            for (int i = 0; i < sx1 - x; ++i) tail[i] = row[x + i];
+            swr_u4_store(tail, swr_circle_lanes(c, swr_u4_load(tail), (float)x, dy2));
+            for (int i = 0; i < sx1 - x; ++i) row[x + i] = tail[i];
+        }
+    }
+}
+
+
+static void swr_draw_command(const SwrCommand *c, int tx0, int ty0, int tx1, int ty1)
+{
+    int x0 = c->x0 > tx0 ? c->x0 : tx0;
+    int y0 = c->y0 > ty0 ? c->y0 : ty0;
+    int x1 = c->x1 < tx1 ? c->x1 : tx1;
+    int y1 = c->y1 < ty1 ? c->y1 : ty1;
+    if (x0 >= x1 || y0 >= y1) return;
+
+    switch (c->type) {
+        case SWR_CLEAR:
+            for (int y = y0; y < y1; ++y) swr_fill_span(&swr.pixels[y*swr.width], x0, x1, c->inner);
+            break;
+        case SWR_RECTANGLE:
+            for (int y = y0; y < y1; ++y) {
+                if (c->inner.a == 255) swr_fill_span(&swr.pixels[y*swr.width], x0, x1, c->inner);
+                else swr_blend_span(&swr.pixels[y*swr.width], x0, x1, c->inner);
+            }
+            break;
+        case SWR_CIRCLE:
+            swr_circle_rows(c, x0, y0, x1, y1);
+            break;
+        default: break;
+    }
+}
+
+
+static void swr_rasterize_tile(void *ctx, int tile)
+{
+    (void) ctx;
+    int tx0 = (tile % swr.tiles_x)*SWR_TILE_SIZE;
+    int ty0 = (tile / swr.tiles_x)*SWR_TILE_SIZE;
+    int tx1 = swr_clampi(tx0 + SWR_TILE_SIZE, 0, swr.width);
+    int ty1 = swr_clampi(ty0 + SWR_TILE_SIZE, 0, swr.height);
+
+    if (swr.overflow) {
+        for (int i = 0; i < swr.command_count; ++i) swr_draw_command(&swr.commands[i], tx0, ty0, tx1, ty1);
+        return;
+    }
+    for (int i = swr.tile_start[tile]; i < swr.tile_start[tile + 1]; ++i) {
+        swr_draw_command(&swr.commands[swr.binned[i]], tx0, ty0, tx1, ty1);
+    }
+}
+
+
+static void swr_bin(void)
+{
+    int tiles = swr.tiles_x*swr.tiles_y;
+    for (int i = 0; i < tiles; ++i) swr.tile_fill[i] = 0;
+
+    // Count, prefix sum, then fill, so every tile gets its commands in order
+    for (int i = 0; i < swr.command_count; ++i) {
+        const SwrCommand *c = &swr.commands[i];
+        for (int ty = c->y0/SWR_TILE_SIZE; ty <= (c->y1 - 1)/SWR_TILE_SIZE; ++ty) {
+            for (int tx = c->x0/SWR_TILE_SIZE; tx <= (c->x1 - 1)/SWR_TILE_SIZE; ++tx) {
+                swr.tile_fill[ty*swr.tiles_x + tx] += 1;
+            }
+        }
+    }
+
+    int total = 0;
+    for (int i = 0; i < tiles; ++i) {
+        swr.tile_start[i] = total;
+        total += swr.tile_fill[i];
+        swr.tile_fill[i] = swr.tile_start[i];
+    }
+    swr.tile_start[tiles] = total;
+    if (total > swr.binned_capacity) {
+        int capacity = swr.binned_capacity > 0 ? swr.binned_capacity : SWR_INITIAL_BINNED;
+        while (capacity < total) capacity *= 2;
+        heap_free(swr.binned);
+        swr.binned = heap_alloc((size_t)capacity*sizeof(*swr.binned));
+        swr.binned_capacity = swr.binned != NULL ? capacity : 0;
+    }
+    swr.overflow = total > swr.binned_capacity;
+    if (swr.overflow) return;
+
+    for (int i = 0; i < swr.command_count; ++i) {
+        const SwrCommand *c = &swr.commands[i];
+        for (int ty = c->y0/SWR_TILE_SIZE; ty <= (c->y1 - 1)/SWR_TILE_SIZE; ++ty) {
+            for (int tx = c->x0/SWR_TILE_SIZE; tx <= (c->x1 - 1)/SWR_TILE_SIZE; ++tx) {
+                swr.binned[swr.tile_fill[ty*swr.tiles_x + tx]++] = i;
+            }
+        }
+    }
+}
+
+
+void swr_end(void)
+{
+    if (swr.tiles_x*swr.tiles_y == 0) return;
+    swr_bin();
+    jobs_parallel_for(swr.tiles_x*swr.tiles_y, swr_rasterize_tile, NULL);
+}
+
+
+unsigned char *swr_pixels(void)
+{
+    return (unsigned char *)swr.pixels;
+}
+
+
+int swr_width(void)
+{
+    return swr.width;
+}
+
+
+int swr_height(void)
+{
+    return swr.height;
+}
+
+#endif // SWRAST_IMPLEMENTATION